@@ -20,6 +20,8 @@
 #define DOSBOX_BIOS_DISK_H
 
 #include <stdio.h>
+#include <vector>
+#include <map>
 #ifndef DOSBOX_MEM_H
 #include "mem.h"
 #endif
@@ -55,7 +57,10 @@ public:
 	Bit8u GetBiosType(void);
 	Bit32u getSectSize(void);
 	imageDisk(FILE *imgFile, Bit8u *imgName, Bit32u imgSizeK, bool isHardDisk);
-	~imageDisk() { if(diskimg != NULL) { fclose(diskimg); }	};
+	~imageDisk();
+	/* Write back the sectors held in the cache */
+	void Flush(void);
+	void CheckFlush(void);
 
 	bool hardDrive;
 	bool active;
@@ -66,8 +71,33 @@ public:
 	Bit32u sector_size;
 	Bit32u heads,cylinders,sectors;
 private:
+	struct CacheLine {
+		Bit32u first;
+		Bit32u valid,dirty;		/* one bit per sector */
+		Bit8u * data;
+		Bitu prev,next;			/* lru order */
+	};
+	size_t FileRead(Bit32u bytenum,void * data,size_t size);
+	size_t FileWrite(Bit32u bytenum,void * data,size_t size);
+	void SetupCache(void);
+	CacheLine * GetLine(Bit32u sectnum);
+	void TouchLine(Bitu index);
+	void FillLine(CacheLine * line);
+	bool WriteLine(CacheLine * line);
+	Bit8u WriteThrough(Bit32u sectnum,void * data);
+
 	Bit32u current_fpos;
 	enum { NONE,READ,WRITE } last_action;
+	std::vector<CacheLine> cache;
+	std::vector<Bit8u> cache_data;
+	std::map<Bit32u,Bitu> cache_index;
+	Bitu cache_mru;
+	Bit32u last_read;
+	bool dirty;
+	Bitu dirty_since;
+	bool write_checked;		/* the first write went to the file */
+	bool write_protected;	/* image opened read-only */
+	bool write_failed;		/* a write back failed, writes go through */
 };
 
 void updateDPT(void);
@@ -82,6 +112,7 @@ extern Bit16u imgDTASeg; /* Real memory location of temporary DTA pointer for fa
 extern RealPt imgDTAPtr; /* Real memory location of temporary DTA pointer for fat image disk access */
 extern DOS_DTA *imgDTA;
 
+void BIOS_FlushDisks(void);
 void swapInDisks(void);
 void swapInNextDisk(void);
 bool getSwapRequest(void);
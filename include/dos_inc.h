@@ -113,6 +113,8 @@ enum { HAND_NONE=0,HAND_FILE,HAND_DEVICE};
 
 /* Routines for File Class */
 void DOS_SetupFiles (void);
+/* Guest buffer of a file transfer that can be used in place, 0 if it needs the copy buffer */
+HostPt DOS_GetDirectBuffer(Bit16u handle,PhysPt buf,Bit16u size,bool toguest);
 bool DOS_ReadFile(Bit16u handle,Bit8u * data,Bit16u * amount, bool fcb = false);
 bool DOS_WriteFile(Bit16u handle,Bit8u * data,Bit16u * amount,bool fcb = false);
 bool DOS_SeekFile(Bit16u handle,Bit32u * pos,Bit32u type,bool fcb = false);
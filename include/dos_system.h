@@ -23,6 +23,8 @@
 #define DOSBOX_DOS_SYSTEM_H
 
 #include <vector>
+#include <map>
+#include <string>
 #ifndef DOSBOX_DOSBOX_H
 #include "dosbox.h"
 #endif
@@ -163,11 +165,13 @@ public:
 			isDir = false;
 			id = MAX_OPENDIRS;
 			nextEntry = shortNr = 0;
+			wineIndexed = false;
+			shortChain = longChain = wineChain = 0;
+			watch = -1;
 		}
 		~CFileInfo(void) {
 			for (Bit32u i=0; i<fileList.size(); i++) delete fileList[i];
 			fileList.clear();
-			longNameList.clear();
 		};
 		char		orgname		[CROSS_LEN];
 		char		shortname	[DOS_NAMELENGTH_ASCII+16];
@@ -177,7 +181,19 @@ public:
 		Bitu		shortNr;
 		// contents
 		std::vector<CFileInfo*>	fileList;
-		std::vector<CFileInfo*>	longNameList;
+		// hash index of the contents by short, long and wine name
+		std::vector<CFileInfo*>	shortIndex;
+		std::vector<CFileInfo*>	longIndex;
+		std::vector<CFileInfo*>	wineIndex;
+		bool		wineIndexed;
+		// lowest number per short name stem that may still be free
+		std::map<std::string,Bitu>	shortNrs;
+		// links in the index of the parent
+		CFileInfo*	shortChain;
+		CFileInfo*	longChain;
+		CFileInfo*	wineChain;
+		// host watch on the contents
+		int		watch;
 	};
 
 private:
@@ -186,9 +202,21 @@ private:
 
 	bool		RemoveTrailingDot	(char* shortname);
 	Bits		GetLongName		(CFileInfo* info, char* shortname);
+	CFileInfo*	FindEntry		(CFileInfo* dir, char* shortname);
+	CFileInfo*	FindShortName		(CFileInfo* dir, const char* shortname);
+	CFileInfo*	FindLongName		(CFileInfo* dir, const char* longname);
+	CFileInfo*	FindWineName		(CFileInfo* dir, const char* shortname);
+	void		IndexEntry		(CFileInfo* dir, CFileInfo* info);
+	void		UnindexEntry		(CFileInfo* dir, CFileInfo* info);
+	void		RebuildIndex		(CFileInfo* dir);
+	bool		RemoveEntry		(const char* path);
+	void		EraseEntry		(CFileInfo* dir, CFileInfo* info);
+	Bits		EntryIndex		(CFileInfo* dir, CFileInfo* info);
+	void		WatchDir		(CFileInfo* dir, const char* path);
+	void		UnwatchDir		(CFileInfo* dir);
+	void		ProcessEvents		(void);
 	void		CreateShortName		(CFileInfo* dir, CFileInfo* info);
-	Bitu		CreateShortNameID	(CFileInfo* dir, const char* name);
-	int		CompareShortname	(const char* compareName, const char* shortName);
+	Bitu		CreateShortNameID	(CFileInfo* dir, const char* shortname, Bitu nr);
 	bool		SetResult		(CFileInfo* dir, char * &result, char * &lresult, Bitu entryNr);
 	bool		IsCachedIn		(CFileInfo* dir);
 	CFileInfo*	FindDirInfo		(const char* path, char* expandedPath);
@@ -217,6 +245,10 @@ private:
 
 	char		label				[CROSS_LEN];
 	bool		updatelabel;
+
+	int		watchFd;
+	bool		watchBusy;
+	std::map<int,CFileInfo*>	watches;
 };
 
 class DOS_Drive {
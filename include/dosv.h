@@ -39,6 +39,10 @@ bool INT10_DOSV_SetCRTBIOSMode(Bitu mode);
 void DOSV_SetConfig(Section_prop *section);
 void DOSV_Setup();
 void DOSV_OffCursor();
+bool DOSV_GetVtextDeferred();
+void DOSV_FlushText();
+void DOSV_MarkTextDirty();
+extern bool dosv_dirty_any;
 void INT8_DOSV();
 Bit16u DOSV_GetFontHandlerOffset(enum DOSV_FONT font);
 enum DOSV_VTEXT_MODE DOSV_GetVtextMode(Bitu no = 0);
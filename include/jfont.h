@@ -23,8 +23,13 @@ Bit8u *GetSbcs24Font(Bitu code);
 void SetFontUse20(bool flag);
 #endif
 void SetFontName(const char *name);
+void OpenFontCache(const char *path);
+void JFONT_InitThreads();
+void PrerenderDbcsFont(Bitu threads);
 Bit8u *GetDbcsFont(Bitu code);
 Bit8u *GetDbcs24Font(Bitu code);
+const Bit8u *GetDbcsGlyph(Bitu code);
+const Bit8u *GetDbcs24Glyph(Bitu code);
 bool CheckStayVz();
 bool CheckAnotherDisplayDriver();
 Bit16u GetGaijiSeg();
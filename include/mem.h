@@ -22,6 +22,7 @@
 #ifndef DOSBOX_DOSBOX_H
 #include "dosbox.h"
 #endif
+#include <stdio.h>
 
 typedef Bit32u PhysPt;
 typedef Bit8u * HostPt;
@@ -37,6 +38,10 @@ HostPt GetMemBase(void);
 bool MEM_A20_Enabled(void);
 void MEM_A20_Enable(bool enable);
 
+/* Guest memory images, an image has to start at a page aligned file offset */
+bool MEM_WriteImage(FILE * f);
+bool MEM_MapImage(FILE * f,Bit32u offset);
+
 /* Memory management / EMS mapping */
 HostPt MEM_GetBlockPage(void);
 Bitu MEM_FreeTotal(void);			//Free 4 kb pages
@@ -154,6 +159,8 @@ void MEM_BlockWrite(PhysPt pt,void const * const data,Bitu size);
 void MEM_BlockRead(PhysPt pt,void * data,Bitu size);
 void MEM_BlockCopy(PhysPt dest,PhysPt src,Bitu size);
 void MEM_StrCopy(PhysPt pt,char * data,Bitu size);
+/* Host pointer to a linear block that is plain ram in one piece, 0 if it isn't */
+HostPt MEM_GetBlockHostPt(PhysPt pt,Bitu size,bool write);
 
 void mem_memcpy(PhysPt dest,PhysPt src,Bitu size);
 Bitu mem_strlen(PhysPt pt);
@@ -29,7 +29,11 @@
 
 // disable this to reduce the size of the TLB
 // NOTE: does not work with the dynamic core (dynrec is fine)
+#if !C_COMPACT_TLB
 #define USE_FULL_TLB
+#elif C_DYNAMIC_X86
+#error "The compact TLB can't be used with the x86 dynamic core"
+#endif
 
 class PageDirectory;
 
@@ -38,6 +42,10 @@ class PageDirectory;
 
 #if defined(USE_FULL_TLB)
 #define TLB_SIZE		(1024*1024)
+#elif C_COMPACT_TLB
+#define TLB_SETS		1024	// This must be a power of 2
+#define TLB_WAYS		4		// This must be a power of 2
+#define TLB_SET(page)	(((page)^((page)>>10))&(TLB_SETS-1))
 #else
 #define TLB_SIZE		65536	// This must a power of 2 and greater then LINK_START
 #define BANK_SHIFT		28
@@ -54,8 +62,13 @@ class PageDirectory;
 
 #define LINK_START	((1024+64)/4)			//Start right after the HMA
 
+#if C_COMPACT_TLB
+//Only the most recent links are looked at, flushing is done by generation
+#define PAGING_LINKS 64
+#else
 //Allow 128 mb of memory to be linked
 #define PAGING_LINKS (128*1024/4)
+#endif
 
 class PageHandler {
 public:
@@ -146,6 +159,10 @@ typedef struct {
 	PageHandler * readhandler;
 	PageHandler * writehandler;
 	Bit32u phys_page;
+#if C_COMPACT_TLB
+	Bit32u lin_page;
+	Bit32u gen;
+#endif
 } tlb_entry;
 #endif
 
@@ -164,6 +181,11 @@ struct PagingBlock {
 		PageHandler * writehandler[TLB_SIZE];
 		Bit32u	phys_page[TLB_SIZE];
 	} tlb;
+#elif C_COMPACT_TLB
+	tlb_entry tlbh[TLB_SETS*TLB_WAYS];
+	tlb_entry tlb_miss;			// returned for pages that are not linked
+	Bit32u tlb_gen;				// entries of older generations are invalid
+	Bitu tlb_victim;
 #else
 	tlb_entry tlbh[TLB_SIZE];
 	tlb_entry *tlbh_banks[TLB_BANKS];
@@ -218,6 +240,41 @@ static INLINE PhysPt PAGING_GetPhysicalAddress(PhysPt linAddr) {
 	return (paging.tlb.phys_page[linAddr>>12]<<12)|(linAddr&0xfff);
 }
 
+#elif C_COMPACT_TLB
+
+static INLINE tlb_entry *get_tlb_entry(PhysPt address) {
+	Bit32u lin_page=address>>12;
+	tlb_entry *set=&paging.tlbh[TLB_SET(lin_page)*TLB_WAYS];
+	for (Bitu i=0;i<TLB_WAYS;i++) {
+		if (set[i].lin_page==lin_page && set[i].gen==paging.tlb_gen) return &set[i];
+	}
+	return &paging.tlb_miss;
+}
+
+static INLINE HostPt get_tlb_read(PhysPt address) {
+	return get_tlb_entry(address)->read;
+}
+static INLINE HostPt get_tlb_write(PhysPt address) {
+	return get_tlb_entry(address)->write;
+}
+static INLINE PageHandler* get_tlb_readhandler(PhysPt address) {
+	return get_tlb_entry(address)->readhandler;
+}
+static INLINE PageHandler* get_tlb_writehandler(PhysPt address) {
+	return get_tlb_entry(address)->writehandler;
+}
+
+/* Use these helper functions to access linear addresses in readX/writeX functions */
+static INLINE PhysPt PAGING_GetPhysicalPage(PhysPt linePage) {
+	tlb_entry *entry = get_tlb_entry(linePage);
+	return (entry->phys_page<<12);
+}
+
+static INLINE PhysPt PAGING_GetPhysicalAddress(PhysPt linAddr) {
+	tlb_entry *entry = get_tlb_entry(linAddr);
+	return (entry->phys_page<<12)|(linAddr&0xfff);
+}
+
 #else
 
 void PAGING_InitTLBBank(tlb_entry **bank);
@@ -0,0 +1,70 @@
+/*
+ *  Copyright (C) 2002-2015  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DOSBOX_SAVESTATE_H
+#define DOSBOX_SAVESTATE_H
+
+#ifndef DOSBOX_DOSBOX_H
+#include "dosbox.h"
+#endif
+#include <string>
+#include <vector>
+
+/* A component describes its state once through the stream, the same
+ * handler is used for saving and loading. */
+class SaveStream {
+public:
+	SaveStream():loading(false),failed(false),in(0),in_size(0),in_pos(0) {}
+	SaveStream(const Bit8u * data,Bitu size):loading(true),failed(false),in(data),in_size(size),in_pos(0) {}
+
+	void Bytes(void * data,Bitu size);
+	void String(std::string & str);
+	template <class T> void Pod(T & val) {
+		Bytes(&val,sizeof(T));
+	}
+	/* Code addresses move between runs, they are kept relative to the binary */
+	template <class T> void Code(T * & func) {
+		Bitu ptr=(Bitu)func;
+		CodePointer(ptr);
+		if (loading) func=(T *)ptr;
+	}
+
+	const std::vector<Bit8u> & Data(void) const { return out; }
+
+	bool loading;
+	bool failed;
+private:
+	void CodePointer(Bitu & ptr);
+	std::vector<Bit8u> out;
+	const Bit8u * in;
+	Bitu in_size,in_pos;
+};
+
+typedef void (SAVESTATE_Handler)(SaveStream & stream);
+
+/* Components are stored in the order they register, which is the init order.
+ * A handler that sets failed while saving refuses the whole state. */
+void SAVESTATE_Register(const char * name,SAVESTATE_Handler * handler);
+bool SAVESTATE_Save(const char * file);
+bool SAVESTATE_Load(const char * file);
+
+/* Requests are carried out from the main loop between two core runs */
+void SAVESTATE_Run(void);
+void SAVESTATE_ShellReady(void);
+
+#endif
@@ -165,6 +165,11 @@ typedef struct {
 		Bit8u count,delay;
 		Bit8u enabled;
 	} cursor;
+	struct {
+		bool enabled;
+		Bitu x, width;
+		Bitu line, lines;
+	} cursor_overlay;
 	Drawmode mode;
 	bool vret_triggered;
 	bool vga_override;
@@ -422,10 +427,17 @@ void VGA_StartResize(Bitu delay=50);
 void VGA_SetupDrawing(Bitu val);
 void VGA_CheckScanLength(void);
 void VGA_ChangedBank(void);
+bool VGA_PlanarDirectAccess(void);
+Bit8u VGA_PlanarReadb(Bitu addr);
+void VGA_PlanarWriteRows(Bitu addr, Bitu pitch, const Bit8u *data, Bitu bytes, Bitu rows);
+void VGA_PlanarCopyRows(Bitu dest, Bitu src, Bitu pitch, Bitu bytes, Bitu rows);
+void VGA_PlanarCopyMask(Bitu dest, Bitu src, Bit8u mask);
+void VGA_PlanarPaint(Bitu addr, Bit8u bits, Bit8u mask, Bit8u fore, Bit8u back);
 
 /* Some DAC/Attribute functions */
 void VGA_DAC_CombineColor(Bit8u attr,Bit8u pal);
 void VGA_DAC_SetEntry(Bitu entry,Bit8u red,Bit8u green,Bit8u blue);
+void VGA_DAC_UpdatePalette(void);
 void VGA_ATTR_SetPalette(Bit8u index,Bit8u val);
 
 typedef enum {CGA, EGA, MONO} EGAMonitorMode;
@@ -450,7 +462,9 @@ void VGA_SetClock(Bitu which,Bitu target);
 void VGA_DACSetEntirePalette(void);
 void VGA_StartRetrace(void);
 void VGA_StartUpdateLFB(void);
-void VGA_SetBlinking(Bitu enabled);
+void VGA_SetBlinking(Bitu enabled);
+void VGA_SetCursorOverlay(Bitu x, Bitu width, Bitu line, Bitu lines);
+void VGA_ClearCursorOverlay(void);
 void VGA_SetCGA2Table(Bit8u val0,Bit8u val1);
 void VGA_SetCGA4Table(Bit8u val0,Bit8u val1,Bit8u val2,Bit8u val3);
 void VGA_ActivateHardwareCursor(void);
@@ -60,6 +60,8 @@
 #define DYN_HASH_SHIFT	(4)
 #define DYN_PAGE_HASH	(4096>>DYN_HASH_SHIFT)
 #define DYN_LINKS		(16)
+#define DYN_TRACE_GAP	(128)
+#define DYN_TRACE_HOT	(16)
 
 
 //#define DYN_LOG 1 //Turn Logging on.
@@ -163,6 +165,7 @@ CacheBlockDynRec * LinkBlocks(BlockReturn ret) {
 		// see if the target is an already translated block
 		block=temp_handler->FindCacheBlock(temp_ip & 4095);
 		if (!block) return NULL;
+		if (block->cache.uses<256) block->cache.uses++;
 
 		// found it, link the current block to
 		cache.block.running->LinkTo(ret==BR_Link2,block);
@@ -206,8 +209,10 @@ Bits CPU_Core_Dynrec_Run(void) {
 		CacheBlockDynRec * block=chandler->FindCacheBlock(ip_point&4095);
 		if (!block) {
 			// no block found, thus translate the instruction stream
-			// unless the instruction is known to be modified
-			if (!chandler->invalidation_map || (chandler->invalidation_map[ip_point&4095]<4)) {
+			// unless the instruction is known to be modified or
+			// has not been run often enough to be worth translating
+			if ((!chandler->invalidation_map || (chandler->invalidation_map[ip_point&4095]<4)) &&
+				(!cache_warmup || chandler->IsWarm(ip_point&4095))) {
 				// translate up to 32 instructions
 				block=CreateCacheBlock(chandler,ip_point,32);
 			} else {
@@ -224,6 +229,15 @@ Bits CPU_Core_Dynrec_Run(void) {
 			}
 		}
 
+		if (block->cache.uses<256) block->cache.uses++;
+		if (GCC_UNLIKELY(block->cache.traceable) && cache_superblocks && (block->cache.uses>=DYN_TRACE_HOT)) {
+			// hot block that ends in a short forward jump, translate it
+			// again and continue through the jump into the next block
+			block->Clear();
+			block=CreateCacheBlock(chandler,ip_point,32,true);
+			block->cache.uses=DYN_TRACE_HOT;
+		}
+
 run_block:
 		cache.block.running=0;
 		// now we're ready to run the dynamic code block
@@ -326,6 +340,24 @@ Bits CPU_Core_Dynrec_Trap_Run(void) {
 void CPU_Core_Dynrec_Init(void) {
 }
 
+void CPU_Core_Dynrec_SetCacheSize(Bitu size_mb,Bitu maxsize_mb) {
+	// takes effect when the code cache is allocated
+	if (cache_code_start_ptr!=NULL) return;
+	cache_config.size=size_mb*1024*1024;
+	cache_config.maxsize=(maxsize_mb>size_mb ? maxsize_mb : size_mb)*1024*1024;
+	// keep the number of code pages per megabyte of the default cache
+	cache_config.pages=CACHE_PAGES*size_mb/(CACHE_TOTAL/(1024*1024));
+	if (cache_config.pages<CACHE_PAGES/2) cache_config.pages=CACHE_PAGES/2;
+}
+
+void CPU_Core_Dynrec_SetWarmup(Bitu count) {
+	cache_warmup=count;
+}
+
+void CPU_Core_Dynrec_SetSuperblocks(bool enable) {
+	cache_superblocks=enable;
+}
+
 void CPU_Core_Dynrec_Cache_Init(bool enable_cache) {
 	// Initialize code cache and dynamic blocks
 	cache_init(enable_cache);
@@ -335,4 +367,8 @@ void CPU_Core_Dynrec_Cache_Close(void) {
 	cache_close();
 }
 
+void CPU_Core_Dynrec_Cache_Reset(void) {
+	while (cache.used_pages) cache.used_pages->ClearRelease();
+}
+
 #endif
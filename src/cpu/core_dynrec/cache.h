@@ -44,6 +44,8 @@ public:
 		Bit8u * wmapmask;
 		Bit16u maskstart;
 		Bit16u masklen;
+		Bitu uses;				// how often the block was entered, decays on every pass of the ring
+		bool traceable;			// ends in a jump that a superblock can continue through
 	} cache;
 	struct {
 		Bitu index;
@@ -77,6 +79,20 @@ static Bit8u * cache_code=NULL;
 static Bit8u * cache_code_link_blocks=NULL;
 
 static CacheBlockDynRec * cache_blocks=NULL;
+
+// the code cache starts with one chunk and grows by another chunk
+// whenever the ring is full, until the maximum size is reached
+static struct {
+	Bitu size;			// size of every chunk
+	Bitu maxsize;		// no chunks are added beyond this total size
+	Bitu total;			// size of all chunks
+	Bitu pages;			// code page handlers added with every chunk
+} cache_config = { CACHE_TOTAL, CACHE_TOTAL, 0, CACHE_PAGES };
+
+// number of times code runs in the normal core before it is translated
+static Bitu cache_warmup=0;
+// retranslate hot blocks that end in a short forward jump as superblocks
+static bool cache_superblocks=false;
 static CacheBlockDynRec link_blocks[2];		// default linking (specially marked)
 
 
@@ -86,6 +102,7 @@ class CodePageHandlerDynRec : public PageHandler {
 public:
 	CodePageHandlerDynRec() {
 		invalidation_map=NULL;
+		warm_map=NULL;
 	}
 
 	void SetupAt(Bitu _phys_page,PageHandler * _old_pagehandler) {
@@ -109,6 +126,26 @@ public:
 			free(invalidation_map);
 			invalidation_map=NULL;
 		}
+		if (warm_map!=NULL) {
+			free(warm_map);
+			warm_map=NULL;
+		}
+	}
+
+	// count the runs of untranslated code, true once it is worth translating
+	bool IsWarm(Bitu addr) {
+		if (!warm_map) {
+			warm_map=(Bit8u*)malloc(4096);
+			memset(warm_map,0,4096);
+		}
+		if (warm_map[addr]>=cache_warmup) return true;
+		warm_map[addr]++;
+		return false;
+	}
+	// modified code starts counting again
+	void ClearWarm(Bitu start,Bitu end) {
+		if (end>4095) end=4095;
+		for (Bitu i=start;i<=end;i++) warm_map[i]=0;
 	}
 
 	// clear out blocks that contain code which has been modified
@@ -143,6 +180,7 @@ public:
 	void writeb(PhysPt addr,Bitu val){
 		addr&=4095;
 		if (host_readb(hostmem+addr)==(Bit8u)val) return;
+		if (GCC_UNLIKELY(warm_map!=NULL)) ClearWarm(addr,addr+0);
 		host_writeb(hostmem+addr,val);
 		// see if there's code where we are writing to
 		if (!host_readb(&write_map[addr])) {
@@ -160,6 +198,7 @@ public:
 	void writew(PhysPt addr,Bitu val){
 		addr&=4095;
 		if (host_readw(hostmem+addr)==(Bit16u)val) return;
+		if (GCC_UNLIKELY(warm_map!=NULL)) ClearWarm(addr,addr+1);
 		host_writew(hostmem+addr,val);
 		// see if there's code where we are writing to
 		if (!host_readw(&write_map[addr])) {
@@ -182,6 +221,7 @@ public:
 	void writed(PhysPt addr,Bitu val){
 		addr&=4095;
 		if (host_readd(hostmem+addr)==(Bit32u)val) return;
+		if (GCC_UNLIKELY(warm_map!=NULL)) ClearWarm(addr,addr+3);
 		host_writed(hostmem+addr,val);
 		// see if there's code where we are writing to
 		if (!host_readd(&write_map[addr])) {
@@ -204,6 +244,7 @@ public:
 	bool writeb_checked(PhysPt addr,Bitu val) {
 		addr&=4095;
 		if (host_readb(hostmem+addr)==(Bit8u)val) return false;
+		if (GCC_UNLIKELY(warm_map!=NULL)) ClearWarm(addr,addr+0);
 		// see if there's code where we are writing to
 		if (!host_readb(&write_map[addr])) {
 			if (!active_blocks) {
@@ -228,6 +269,7 @@ public:
 	bool writew_checked(PhysPt addr,Bitu val) {
 		addr&=4095;
 		if (host_readw(hostmem+addr)==(Bit16u)val) return false;
+		if (GCC_UNLIKELY(warm_map!=NULL)) ClearWarm(addr,addr+1);
 		// see if there's code where we are writing to
 		if (!host_readw(&write_map[addr])) {
 			if (!active_blocks) {
@@ -257,6 +299,7 @@ public:
 	bool writed_checked(PhysPt addr,Bitu val) {
 		addr&=4095;
 		if (host_readd(hostmem+addr)==(Bit32u)val) return false;
+		if (GCC_UNLIKELY(warm_map!=NULL)) ClearWarm(addr,addr+3);
 		// see if there's code where we are writing to
 		if (!host_readd(&write_map[addr])) {
 			if (!active_blocks) {
@@ -383,6 +426,7 @@ public:
 	// the write map, there are write_map[i] cache blocks that cover the byte at address i
 	Bit8u write_map[4096];
 	Bit8u * invalidation_map;
+	Bit8u * warm_map;		// how often untranslated code has been run by the normal core
 	CodePageHandlerDynRec * next, * prev;	// page linking
 private:
 	PageHandler * old_pagehandler;
@@ -403,10 +447,24 @@ static INLINE void cache_addunusedblock(CacheBlockDynRec * block) {
 	cache.block.free=block;
 }
 
+static void cache_addblocks(void) {
+	// allocate another set of cache blocks and put them on the freelist
+	CacheBlockDynRec * blocks=(CacheBlockDynRec*)malloc(CACHE_BLOCKS*sizeof(CacheBlockDynRec));
+	if (!blocks) E_Exit("Ran out of CacheBlocks");
+	memset(blocks,0,sizeof(CacheBlockDynRec)*CACHE_BLOCKS);
+	for (Bitu i=0;i<CACHE_BLOCKS;i++) {
+		blocks[i].link[0].to=(CacheBlockDynRec *)1;
+		blocks[i].link[1].to=(CacheBlockDynRec *)1;
+		blocks[i].cache.next=(i<CACHE_BLOCKS-1) ? &blocks[i+1] : cache.block.free;
+	}
+	cache.block.free=&blocks[0];
+	if (!cache_blocks) cache_blocks=blocks;
+}
+
 static CacheBlockDynRec * cache_getblock(void) {
 	// get a free cache block and advance the free pointer
+	if (!cache.block.free) cache_addblocks();
 	CacheBlockDynRec * ret=cache.block.free;
-	if (!ret) E_Exit("Ran out of CacheBlocks" );
 	cache.block.free=ret->cache.next;
 	ret->cache.next=0;
 	return ret;
@@ -459,30 +517,72 @@ void CacheBlockDynRec::Clear(void) {
 }
 
 
-static CacheBlockDynRec * cache_openblock(void) {
-	CacheBlockDynRec * block=cache.block.active;
-	// check for enough space in this block
-	Bitu size=block->cache.size;
+// the last block of a chunk may overrun into the chunk's CACHE_MAXSIZE slack
+static INLINE bool cache_lastinchunk(CacheBlockDynRec * block) {
 	CacheBlockDynRec * nextblock=block->cache.next;
+	return !nextblock || (nextblock->cache.start!=block->cache.start+block->cache.size);
+}
+
+// blocks that were entered since the last pass of the ring are kept
+static INLINE bool cache_ishot(CacheBlockDynRec * block) {
+	return block->page.handler && (block->cache.uses>1);
+}
+
+static bool cache_addchunk(CacheBlockDynRec * lastblock);
+
+static void cache_advance(CacheBlockDynRec * block) {
+	if (block->cache.next) {
+		cache.block.active=block->cache.next;
+		return;
+	}
+	// end of the ring, grow the cache if allowed or start over
+	if (!cache_addchunk(block)) {
+//		LOG_MSG("Cache full restarting");
+		cache.block.active=cache.block.first;
+	}
+}
+
+static CacheBlockDynRec * cache_openblock(void) {
+	CacheBlockDynRec * block;
+	Bitu size;
+	CacheBlockDynRec * nextblock;
+	for (;;) {
+		block=cache.block.active;
+		if (cache_ishot(block)) {
+			// keep hot code, but let it cool down until the next pass
+			block->cache.uses>>=1;
+			cache_advance(block);
+			continue;
+		}
+		// see if enough cold blocks follow to hold CACHE_MAXSIZE
+		size=block->cache.size;
+		nextblock=block->cache.next;
+		while (size<CACHE_MAXSIZE && nextblock &&
+			nextblock->cache.start==block->cache.start+size && !cache_ishot(nextblock)) {
+			size+=nextblock->cache.size;
+			nextblock=nextblock->cache.next;
+		}
+		if (size>=CACHE_MAXSIZE || !nextblock || nextblock->cache.start!=block->cache.start+size) break;
+		// a hot block is in the way, continue right behind it
+		cache.block.active=nextblock;
+	}
+	// clear out the blocks and merge them
 	if (block->page.handler) 
 		block->Clear();
-	// block size must be at least CACHE_MAXSIZE
-	while (size<CACHE_MAXSIZE) {
-		if (!nextblock)
-			goto skipresize;
-		// merge blocks
-		size+=nextblock->cache.size;
-		CacheBlockDynRec * tempblock=nextblock->cache.next;
-		if (nextblock->page.handler) 
-			nextblock->Clear();
+	CacheBlockDynRec * mergeblock=block->cache.next;
+	while (mergeblock!=nextblock) {
+		CacheBlockDynRec * tempblock=mergeblock->cache.next;
+		if (mergeblock->page.handler) 
+			mergeblock->Clear();
 		// block is free now
-		cache_addunusedblock(nextblock);
-		nextblock=tempblock;
+		cache_addunusedblock(mergeblock);
+		mergeblock=tempblock;
 	}
-skipresize:
 	// adjust parameters and open this block
 	block->cache.size=size;
 	block->cache.next=nextblock;
+	block->cache.uses=0;
+	block->cache.traceable=false;
 	cache.pos=block->cache.start;
 	return block;
 }
@@ -499,7 +599,7 @@ static void cache_closeblock(void) {
 	// close the block with correct alignment
 	Bitu written=(Bitu)(cache.pos-block->cache.start);
 	if (written>block->cache.size) {
-		if (!block->cache.next) {
+		if (cache_lastinchunk(block)) {
 			if (written>block->cache.size+CACHE_MAXSIZE) E_Exit("CacheBlock overrun 1 %d",written-block->cache.size);	
 		} else E_Exit("CacheBlock overrun 2 written %d size %d",written,block->cache.size);	
 	} else {
@@ -518,12 +618,7 @@ static void cache_closeblock(void) {
 		}
 	}
 	// advance the active block pointer
-	if (!block->cache.next || (block->cache.next->cache.start>(cache_code_start_ptr + CACHE_TOTAL - CACHE_MAXSIZE))) {
-//		LOG_MSG("Cache full restarting");
-		cache.block.active=cache.block.first;
-	} else {
-		cache.block.active=block->cache.next;
-	}
+	cache_advance(block);
 }
 
 
@@ -564,52 +659,96 @@ static void dyn_run_code(void);
 
 static bool cache_initialized = false;
 
+// every allocation of the code cache, given back by cache_close
+struct CacheChunkDynRec {
+	Bit8u * start_ptr;			// start of the allocation, before the alignment
+	bool virtualalloc;			// allocated with VirtualAlloc instead of malloc
+	CacheChunkDynRec * next;
+};
+static CacheChunkDynRec * cache_chunks=NULL;
+
+// allocate executable memory for a chunk of the code cache, preceded by one page
+static Bit8u * cache_allocchunk(Bitu size,Bit8u * * start_ptr) {
+	bool virtualalloc=false;
+#if defined (WIN32)
+	*start_ptr=(Bit8u*)VirtualAlloc(0,size+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP,
+		MEM_COMMIT,PAGE_EXECUTE_READWRITE);
+	if (*start_ptr) virtualalloc=true;
+	else
+		*start_ptr=(Bit8u*)malloc(size+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
+#else
+	*start_ptr=(Bit8u*)malloc(size+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
+#endif
+	if (!*start_ptr) return NULL;
+	CacheChunkDynRec * entry=new CacheChunkDynRec;
+	entry->start_ptr=*start_ptr;
+	entry->virtualalloc=virtualalloc;
+	entry->next=cache_chunks;
+	cache_chunks=entry;
+
+	// align the cache at a page boundary
+	Bit8u * chunk=(Bit8u*)(((Bitu)*start_ptr + PAGESIZE_TEMP-1) & ~(PAGESIZE_TEMP-1));//Bitu is same size as a pointer.
+
+#if (C_HAVE_MPROTECT)
+	if(mprotect(chunk,size+CACHE_MAXSIZE+PAGESIZE_TEMP,PROT_WRITE|PROT_READ|PROT_EXEC))
+		LOG_MSG("Setting excute permission on the code cache has failed");
+#endif
+	return chunk;
+}
+
+static void cache_addpages(Bitu count) {
+	for (Bitu i=0;i<count;i++) {
+		CodePageHandlerDynRec * newpage=new CodePageHandlerDynRec();
+		newpage->next=cache.free_pages;
+		cache.free_pages=newpage;
+	}
+}
+
+static bool cache_addchunk(CacheBlockDynRec * lastblock) {
+	if (cache_config.total+cache_config.size>cache_config.maxsize) return false;
+	Bit8u * start_ptr;
+	Bit8u * chunk=cache_allocchunk(cache_config.size,&start_ptr);
+	if (!chunk) {
+		// stay with the current size from now on
+		cache_config.maxsize=cache_config.total;
+		return false;
+	}
+	cache_config.total+=cache_config.size;
+	LOG(LOG_CPU,LOG_NORMAL)("Dynamic code cache grown to %d KB",cache_config.total>>10);
+	// append the chunk to the ring, the first page is left unused
+	CacheBlockDynRec * block=cache_getblock();
+	block->cache.start=chunk+PAGESIZE_TEMP;
+	block->cache.size=cache_config.size;
+	block->cache.next=0;
+	lastblock->cache.next=block;
+	cache.block.active=block;
+	cache_addpages(cache_config.pages);
+	return true;
+}
+
 static void cache_init(bool enable) {
-	Bits i;
 	if (enable) {
 		// see if cache is already initialized
 		if (cache_initialized) return;
 		cache_initialized = true;
 		if (cache_blocks == NULL) {
 			// allocate the cache blocks memory
-			cache_blocks=(CacheBlockDynRec*)malloc(CACHE_BLOCKS*sizeof(CacheBlockDynRec));
-			if(!cache_blocks) E_Exit("Allocating cache_blocks has failed");
-			memset(cache_blocks,0,sizeof(CacheBlockDynRec)*CACHE_BLOCKS);
-			cache.block.free=&cache_blocks[0];
-			// initialize the cache blocks
-			for (i=0;i<CACHE_BLOCKS-1;i++) {
-				cache_blocks[i].link[0].to=(CacheBlockDynRec *)1;
-				cache_blocks[i].link[1].to=(CacheBlockDynRec *)1;
-				cache_blocks[i].cache.next=&cache_blocks[i+1];
-			}
+			cache_addblocks();
 		}
 		if (cache_code_start_ptr==NULL) {
 			// allocate the code cache memory
-#if defined (WIN32)
-			cache_code_start_ptr=(Bit8u*)VirtualAlloc(0,CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP,
-				MEM_COMMIT,PAGE_EXECUTE_READWRITE);
-			if (!cache_code_start_ptr)
-				cache_code_start_ptr=(Bit8u*)malloc(CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
-#else
-			cache_code_start_ptr=(Bit8u*)malloc(CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
-#endif
-			if(!cache_code_start_ptr) E_Exit("Allocating dynamic cache failed");
-
-			// align the cache at a page boundary
-			cache_code=(Bit8u*)(((Bitu)cache_code_start_ptr + PAGESIZE_TEMP-1) & ~(PAGESIZE_TEMP-1));//Bitu is same size as a pointer.
+			cache_code=cache_allocchunk(cache_config.size,&cache_code_start_ptr);
+			if(!cache_code) E_Exit("Allocating dynamic cache failed");
+			cache_config.total=cache_config.size;
 
 			cache_code_link_blocks=cache_code;
 			cache_code=cache_code+PAGESIZE_TEMP;
 
-#if (C_HAVE_MPROTECT)
-			if(mprotect(cache_code_link_blocks,CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP,PROT_WRITE|PROT_READ|PROT_EXEC))
-				LOG_MSG("Setting excute permission on the code cache has failed");
-#endif
 			CacheBlockDynRec * block=cache_getblock();
 			cache.block.first=block;
 			cache.block.active=block;
 			block->cache.start=&cache_code[0];
-			block->cache.size=CACHE_TOTAL;
+			block->cache.size=cache_config.size;
 			block->cache.next=0;						// last block in the list
 		}
 		// setup the default blocks for block linkage returns
@@ -631,11 +770,7 @@ static void cache_init(bool enable) {
 		cache.last_page=0;
 		cache.used_pages=0;
 		// setup the code pages
-		for (i=0;i<CACHE_PAGES;i++) {
-			CodePageHandlerDynRec * newpage=new CodePageHandlerDynRec();
-			newpage->next=cache.free_pages;
-			cache.free_pages=newpage;
-		}
+		cache_addpages(cache_config.pages);
 	}
 }
 
@@ -662,4 +797,16 @@ static void cache_close(void) {
 	cache_code = NULL;
 	cache_code_link_blocks = NULL;
 	cache_initialized = false; */
+	// the cache is not run again after this, so only its memory is given back
+	while (cache_chunks) {
+		CacheChunkDynRec * entry=cache_chunks;
+		cache_chunks=entry->next;
+#if defined (WIN32)
+		if (entry->virtualalloc) VirtualFree(entry->start_ptr,0,MEM_RELEASE);
+		else
+#endif
+		free(entry->start_ptr);
+		delete entry;
+	}
+	cache_code_start_ptr=NULL;
 }
@@ -31,8 +31,9 @@
 	instruction is encountered.
 */
 
-static CacheBlockDynRec * CreateCacheBlock(CodePageHandlerDynRec * codepage,PhysPt start,Bitu max_opcodes) {
+static CacheBlockDynRec * CreateCacheBlock(CodePageHandlerDynRec * codepage,PhysPt start,Bitu max_opcodes,bool superblock=false) {
 	// initialize a load of variables
+	decode.superblock=superblock;
 	decode.code_start=start;
 	decode.code=start;
 	decode.page.code=codepage;
@@ -512,17 +513,25 @@ restart_prefix:
 			dyn_call_near_imm();
 			goto finish_block;
 		// 'jmp near imm16/32'
-		case 0xe9:
-			dyn_exit_link(decode.big_op ? (Bit32s)decode_fetchd() : (Bit16s)decode_fetchw());
+		case 0xe9: {
+			Bits eip_change=decode.big_op ? (Bit32s)decode_fetchd() : (Bit16s)decode_fetchw();
+			if (dyn_follow_jump(eip_change)) break;
+			if (dyn_flags_dead_after(eip_change)) InvalidateFlags();
+			dyn_exit_link(eip_change);
 			goto finish_block;
+			}
 		// 'jmp far'
 		case 0xea:
 			dyn_jmp_far_imm();
 			goto finish_block;
 		// 'jmp short imm8'
-		case 0xeb:
-			dyn_exit_link((Bit8s)decode_fetchb());
+		case 0xeb: {
+			Bits eip_change=(Bit8s)decode_fetchb();
+			if (dyn_follow_jump(eip_change)) break;
+			if (dyn_flags_dead_after(eip_change)) InvalidateFlags();
+			dyn_exit_link(eip_change);
 			goto finish_block;
+			}
 
 
 		// repeat prefixes
@@ -587,6 +596,7 @@ restart_prefix:
 		}
 	}
 	// link to next block because the maximum number of opcodes has been reached
+	if (dyn_flags_dead_after(0)) InvalidateFlags();
 	dyn_set_eip_end();
 	dyn_reduce_cycles();
 	gen_jmp_ptr(&decode.block->link[0].to,offsetof(CacheBlockDynRec,cache.start));
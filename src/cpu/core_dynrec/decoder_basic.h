@@ -103,6 +103,7 @@ static struct DynDecode {
 	Bitu cycles;			// number cycles used by currently translated code
 	bool seg_prefix_used;	// segment overridden
 	Bit8u seg_prefix;		// segment prefix (if seg_prefix_used==true)
+	bool superblock;		// continue through short forward jumps
 
 	// block that contains the first instruction translated
 	CacheBlockDynRec * block;
@@ -1265,3 +1266,138 @@ static void AcquireFlags(Bitu flags_mask) {
 	mf_functions_num=0;
 #endif
 }
+
+
+// look ahead at the code the block continues with to find out whether the
+// condition flags are overwritten before they are read
+
+#define DYN_FLAGS_LOOKAHEAD 8
+
+// length of the modrm byte and the following sib/displacement bytes
+static bool dyn_lookahead_modrm(PhysPt page_base,Bitu & pos,bool big_addr,Bitu & reg) {
+	if (pos>=4096) return false;
+	Bitu modrm=mem_readb(page_base+pos++);
+	Bitu mod=modrm>>6;
+	Bitu rm=modrm&7;
+	reg=(modrm>>3)&7;
+	if (mod==3) return true;
+	if (big_addr) {
+		if (rm==4) {
+			if (pos>=4096) return false;
+			Bitu sib=mem_readb(page_base+pos++);
+			if ((mod==0) && ((sib&7)==5)) pos+=4;
+		} else if ((mod==0) && (rm==5)) pos+=4;
+		if (mod==1) pos+=1;
+		else if (mod==2) pos+=4;
+	} else {
+		if ((mod==0) && (rm==6)) pos+=2;
+		else if (mod==1) pos+=1;
+		else if (mod==2) pos+=2;
+	}
+	return true;
+}
+
+// 1 if the instruction at pos sets all condition flags without reading them,
+// 0 if it does not touch them, -1 if it reads them or is not known
+static Bits dyn_lookahead_flags(PhysPt page_base,Bitu & pos) {
+	bool big_op=cpu.code.big;
+	bool big_addr=cpu.code.big;
+	Bitu opcode;
+	for (;;) {
+		if (pos>=4096) return -1;
+		opcode=mem_readb(page_base+pos++);
+		if (opcode==0x66) big_op=!cpu.code.big;
+		else if (opcode==0x67) big_addr=!cpu.code.big;
+		else if ((opcode!=0x26) && (opcode!=0x2e) && (opcode!=0x36) &&
+			(opcode!=0x3e) && (opcode!=0x64) && (opcode!=0x65)) break;
+	}
+	Bitu immv=big_op ? 4 : 2;
+	Bitu reg;
+	Bits ret;
+	if ((opcode<0x40) && ((opcode&7)<6)) {
+		// add/or/and/sub/xor/cmp, adc and sbb read the carry
+		Bitu op=(opcode>>3)&7;
+		if ((op==2) || (op==3)) return -1;
+		switch (opcode&7) {
+		case 4:pos+=1;break;
+		case 5:pos+=immv;break;
+		default:
+			if (!dyn_lookahead_modrm(page_base,pos,big_addr,reg)) return -1;
+			break;
+		}
+		ret=1;
+	} else switch (opcode) {
+	case 0x80:case 0x82:case 0x83:
+		if (!dyn_lookahead_modrm(page_base,pos,big_addr,reg)) return -1;
+		if ((reg==2) || (reg==3)) return -1;
+		pos+=1;
+		ret=1;
+		break;
+	case 0x81:
+		if (!dyn_lookahead_modrm(page_base,pos,big_addr,reg)) return -1;
+		if ((reg==2) || (reg==3)) return -1;
+		pos+=immv;
+		ret=1;
+		break;
+	case 0x84:case 0x85:
+		if (!dyn_lookahead_modrm(page_base,pos,big_addr,reg)) return -1;
+		ret=1;
+		break;
+	case 0xa8:pos+=1;ret=1;break;
+	case 0xa9:pos+=immv;ret=1;break;
+	case 0x86:case 0x87:case 0x88:case 0x89:case 0x8a:case 0x8b:
+	case 0x8c:case 0x8d:case 0x8e:
+		if (!dyn_lookahead_modrm(page_base,pos,big_addr,reg)) return -1;
+		ret=0;
+		break;
+	case 0xc6:
+		if (!dyn_lookahead_modrm(page_base,pos,big_addr,reg)) return -1;
+		pos+=1;
+		ret=0;
+		break;
+	case 0xc7:
+		if (!dyn_lookahead_modrm(page_base,pos,big_addr,reg)) return -1;
+		pos+=immv;
+		ret=0;
+		break;
+	case 0xa0:case 0xa1:case 0xa2:case 0xa3:
+		pos+=big_addr ? 4 : 2;
+		ret=0;
+		break;
+	default:
+		if ((opcode>=0x50) && (opcode<=0x5f)) ret=0;			// push/pop reg
+		else if ((opcode>=0x90) && (opcode<=0x97)) ret=0;		// nop/xchg
+		else if ((opcode>=0xb0) && (opcode<=0xb7)) {pos+=1;ret=0;}
+		else if ((opcode>=0xb8) && (opcode<=0xbf)) {pos+=immv;ret=0;}
+		else return -1;
+		break;
+	}
+	if (pos>4096) return -1;
+	return ret;
+}
+
+// see if the flags are dead when the block continues at ip+eip_change,
+// the bytes looked at are added to the block so modifying them clears it
+static bool dyn_flags_dead_after(Bits eip_change) {
+#ifdef DRC_FLAGS_INVALIDATION
+	if (!mf_functions_num || decode.page.invmap) return false;
+	// the continuation must be in the current page and not wrap ip
+	Bit32u eip=reg_eip+(Bit32u)(decode.code-decode.code_start);
+	if (!decode.big_op && ((Bit32u)(eip+eip_change)>0xffff)) return false;
+	PhysPt page_base=decode.code-decode.page.index;
+	PhysPt target=decode.code+eip_change;
+	if ((target<page_base) || (target-page_base>=4096)) return false;
+	Bitu pos=target-page_base;
+	// code before the block start in this page is not covered by the block
+	if (pos<decode.active_block->page.start) return false;
+	for (Bitu count=0;count<DYN_FLAGS_LOOKAHEAD;count++) {
+		Bits res=dyn_lookahead_flags(page_base,pos);
+		if (res<0) return false;
+		if (res>0) {
+			for (;decode.page.index<pos;decode.page.index++) decode.page.wmap[decode.page.index]+=0x01;
+			return true;
+		}
+	}
+#endif
+	return false;
+}
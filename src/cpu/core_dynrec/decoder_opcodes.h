@@ -1085,6 +1085,25 @@ static void dyn_sahf(void) {
 }
 
 
+// continue the translation behind a short forward jump instead of ending
+// the block, the skipped bytes are covered by the block for SMC detection
+static bool dyn_follow_jump(Bits eip_change) {
+	if (eip_change<0 || eip_change>DYN_TRACE_GAP) return false;
+	if (decode.page.index+eip_change>=4096) return false;
+	// the jump must not wrap ip, block offsets are taken from the linear address
+	Bit32u eip=reg_eip+(Bit32u)(decode.code-decode.code_start);
+	if (!decode.big_op && (eip+eip_change>0xffff)) return false;
+	if (eip+eip_change<eip) return false;
+	if (!decode.superblock) {
+		decode.block->cache.traceable=true;
+		return false;
+	}
+	for (Bits i=0;i<eip_change;i++) decode.page.wmap[decode.page.index+i]+=0x01;
+	decode.page.index+=eip_change;
+	decode.code+=eip_change;
+	return true;
+}
+
 static void dyn_exit_link(Bits eip_change) {
 	gen_add_direct_word(&reg_eip,(decode.code-decode.code_start)+eip_change,decode.big_op);
 	dyn_reduce_cycles();
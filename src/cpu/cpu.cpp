@@ -30,6 +30,7 @@
 #include "paging.h"
 #include "lazyflags.h"
 #include "support.h"
+#include "savestate.h"
 
 Bitu DEBUG_EnableDebugger(void);
 extern void GFX_SetTitle(Bit32s cycles ,Bits frameskip,bool paused);
@@ -75,11 +76,16 @@ void CPU_Core_Simple_Init(void);
 void CPU_Core_Dyn_X86_Init(void);
 void CPU_Core_Dyn_X86_Cache_Init(bool enable_cache);
 void CPU_Core_Dyn_X86_Cache_Close(void);
+void CPU_Core_Dyn_X86_Cache_Reset(void);
 void CPU_Core_Dyn_X86_SetFPUMode(bool dh_fpu);
 #elif (C_DYNREC)
 void CPU_Core_Dynrec_Init(void);
 void CPU_Core_Dynrec_Cache_Init(bool enable_cache);
 void CPU_Core_Dynrec_Cache_Close(void);
+void CPU_Core_Dynrec_Cache_Reset(void);
+void CPU_Core_Dynrec_SetCacheSize(Bitu size_mb,Bitu maxsize_mb);
+void CPU_Core_Dynrec_SetWarmup(Bitu count);
+void CPU_Core_Dynrec_SetSuperblocks(bool enable);
 #endif
 
 /* In debug mode exceptions are tested and dosbox exits when 
@@ -2228,6 +2234,10 @@ public:
 #if (C_DYNAMIC_X86)
 		CPU_Core_Dyn_X86_Init();
 #elif (C_DYNREC)
+		Section_prop * section=static_cast<Section_prop *>(configuration);
+		CPU_Core_Dynrec_SetCacheSize(section->Get_int("dyncache"),section->Get_int("dyncachemax"));
+		CPU_Core_Dynrec_SetWarmup(section->Get_int("dynwarmup"));
+		CPU_Core_Dynrec_SetSuperblocks(section->Get_bool("dynsuperblocks"));
 		CPU_Core_Dynrec_Init();
 #endif
 		MAPPER_AddHandler(CPU_CycleDecrease,MK_f11,MMOD1,"cycledown","Dec Cycles");
@@ -2410,6 +2420,27 @@ public:
 	
 static CPU * test;
 
+static void CPU_SaveState(SaveStream & stream) {
+	stream.Pod(cpu_regs);
+	stream.Pod(Segs);
+	stream.Pod(lflags);
+	stream.Pod(cpu);
+	stream.Code(cpu.hlt.old_decoder);
+	stream.Pod(cpu_tss);
+	stream.Pod(CPU_Cycles);
+	stream.Pod(CPU_CycleLeft);
+	stream.Pod(CPU_IODelayRemoved);
+	stream.Code(cpudecoder);
+	if (stream.loading) {
+		/* Translated blocks belong to the code that was just replaced */
+#if (C_DYNAMIC_X86)
+		CPU_Core_Dyn_X86_Cache_Reset();
+#elif (C_DYNREC)
+		CPU_Core_Dynrec_Cache_Reset();
+#endif
+	}
+}
+
 void CPU_ShutDown(Section* sec) {
 #if (C_DYNAMIC_X86)
 	CPU_Core_Dyn_X86_Cache_Close();
@@ -2422,6 +2453,7 @@ void CPU_ShutDown(Section* sec) {
 void CPU_Init(Section* sec) {
 	test = new CPU(sec);
 	sec->AddDestroyFunction(&CPU_ShutDown,true);
+	SAVESTATE_Register("cpu",&CPU_SaveState);
 }
 //initialize static members
 bool CPU::inited=false;
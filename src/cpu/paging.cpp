@@ -29,6 +29,7 @@
 #include "cpu.h"
 #include "debug.h"
 #include "setup.h"
+#include "savestate.h"
 
 #define LINK_TOTAL		(64*1024)
 
@@ -731,6 +732,107 @@ void PAGING_LinkPage_ReadOnly(Bitu lin_page,Bitu phys_page) {
 	paging.tlb.writehandler[lin_page]=&init_page_handler_userro;
 }
 
+#elif C_COMPACT_TLB
+
+static void InitTLBEntry(tlb_entry *entry) {
+	entry->read=0;
+	entry->write=0;
+	entry->readhandler=&init_page_handler;
+	entry->writehandler=&init_page_handler;
+	entry->phys_page=0;
+	entry->lin_page=0;
+	entry->gen=0;
+}
+
+/* Find the entry of a page in its set, reusing a stale or the oldest one */
+static tlb_entry *AllocTLBEntry(Bitu lin_page) {
+	tlb_entry *set=&paging.tlbh[TLB_SET(lin_page)*TLB_WAYS];
+	tlb_entry *entry=0;
+	for (Bitu i=0;i<TLB_WAYS;i++) {
+		if (set[i].gen!=paging.tlb_gen) {
+			if (!entry) entry=&set[i];
+		} else if (set[i].lin_page==lin_page) return &set[i];
+	}
+	if (!entry) {
+		/* Evicting only means the page goes through the init handler again */
+		entry=&set[paging.tlb_victim];
+		paging.tlb_victim=(paging.tlb_victim+1)&(TLB_WAYS-1);
+	}
+	entry->lin_page=lin_page;
+	entry->gen=paging.tlb_gen;
+	return entry;
+}
+
+void PAGING_InitTLB(void) {
+	for (Bitu i=0;i<TLB_SETS*TLB_WAYS;i++) InitTLBEntry(&paging.tlbh[i]);
+	InitTLBEntry(&paging.tlb_miss);
+	paging.tlb_gen=1;
+	paging.tlb_victim=0;
+	paging.links.used=0;
+}
+
+void PAGING_ClearTLB(void) {
+	/* Generation 0 marks unused entries, so restart when wrapping */
+	if (GCC_UNLIKELY(++paging.tlb_gen==0)) PAGING_InitTLB();
+	paging.links.used=0;
+}
+
+void PAGING_UnlinkPages(Bitu lin_page,Bitu pages) {
+	for (;pages>0;pages--) {
+		tlb_entry *entry = get_tlb_entry(lin_page<<12);
+		if (entry!=&paging.tlb_miss) entry->gen=0;
+		lin_page++;
+	}
+}
+
+void PAGING_MapPage(Bitu lin_page,Bitu phys_page) {
+	if (lin_page<LINK_START) {
+		paging.firstmb[lin_page]=phys_page;
+		PAGING_UnlinkPages(lin_page,1);
+	} else {
+		PAGING_LinkPage(lin_page,phys_page);
+	}
+}
+
+void PAGING_LinkPage(Bitu lin_page,Bitu phys_page) {
+	PageHandler * handler=MEM_GetPageHandler(phys_page);
+	Bitu lin_base=lin_page << 12;
+	if (lin_page>=(1024*1024) || phys_page>=(1024*1024)) 
+		E_Exit("Illegal page");
+
+	if (paging.links.used>=PAGING_LINKS) paging.links.used=0;
+
+	tlb_entry *entry = AllocTLBEntry(lin_page);
+	entry->phys_page=phys_page;
+	if (handler->flags & PFLAG_READABLE) entry->read=handler->GetHostReadPt(phys_page)-lin_base;
+	else entry->read=0;
+	if (handler->flags & PFLAG_WRITEABLE) entry->write=handler->GetHostWritePt(phys_page)-lin_base;
+	else entry->write=0;
+
+	paging.links.entries[paging.links.used++]=lin_page;
+	entry->readhandler=handler;
+	entry->writehandler=handler;
+}
+
+void PAGING_LinkPage_ReadOnly(Bitu lin_page,Bitu phys_page) {
+	PageHandler * handler=MEM_GetPageHandler(phys_page);
+	Bitu lin_base=lin_page << 12;
+	if (lin_page>=(1024*1024) || phys_page>=(1024*1024)) 
+		E_Exit("Illegal page");
+
+	if (paging.links.used>=PAGING_LINKS) paging.links.used=0;
+
+	tlb_entry *entry = AllocTLBEntry(lin_page);
+	entry->phys_page=phys_page;
+	if (handler->flags & PFLAG_READABLE) entry->read=handler->GetHostReadPt(phys_page)-lin_base;
+	else entry->read=0;
+	entry->write=0;
+
+	paging.links.entries[paging.links.used++]=lin_page;
+	entry->readhandler=handler;
+	entry->writehandler=&init_page_handler_userro;
+}
+
 #else
 
 static INLINE void InitTLBInt(tlb_entry *bank) {
@@ -869,6 +971,20 @@ bool PAGING_Enabled(void) {
 	return paging.enabled;
 }
 
+static void PAGING_SaveState(SaveStream & stream) {
+	/* Drop the links of the current state before taking the saved one */
+	if (stream.loading) PAGING_ClearTLB();
+	stream.Pod(paging.cr2);
+	stream.Pod(paging.cr3);
+	stream.Pod(paging.enabled);
+	stream.Pod(paging.firstmb);
+	if (stream.loading) {
+		paging.base.page=paging.cr3 >> 12;
+		paging.base.addr=paging.cr3 & ~4095;
+		PAGING_ClearTLB();
+	}
+}
+
 class PAGING:public Module_base{
 public:
 	PAGING(Section* configuration):Module_base(configuration){
@@ -880,6 +996,7 @@ public:
 			paging.firstmb[i]=i;
 		}
 		pf_queue.used=0;
+		SAVESTATE_Register("paging",&PAGING_SaveState);
 	}
 	~PAGING(){}
 };
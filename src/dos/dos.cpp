@@ -37,6 +37,7 @@
 #include "j3.h"
 #include "dosv.h"
 #include "jfont.h"
+#include "savestate.h"
 #include <time.h>
 
 #define	IAS_DEVICE_HANDLE		0x1a50
@@ -49,6 +50,10 @@ extern int lfn_filefind_handle;
 extern bool force;
 extern bool LineInputFlag;
 extern bool CtrlCFlag;
+extern bool localfile_map;
+extern bool dircache_watch;
+extern Bitu imagedisk_cachesize;
+extern Bitu imagedisk_flushdelay;
 
 #define DOS_COPYBUFSIZE 0x10000
 Bit8u dos_copybuf[DOS_COPYBUFSIZE];
@@ -1002,9 +1007,10 @@ static Bitu DOS_21Handler(void) {
 	case 0x3f:		/* READ Read from file or device */
 		{ 
 			Bit16u toread=reg_cx;
+			HostPt direct=DOS_GetDirectBuffer(reg_bx,SegPhys(ds)+reg_dx,toread,true);
 			dos.echo=true;
-			if (DOS_ReadFile(reg_bx,dos_copybuf,&toread)) {
-				MEM_BlockWrite(SegPhys(ds)+reg_dx,dos_copybuf,toread);
+			if (DOS_ReadFile(reg_bx,direct ? direct : dos_copybuf,&toread)) {
+				if (!direct) MEM_BlockWrite(SegPhys(ds)+reg_dx,dos_copybuf,toread);
 				reg_ax=toread;
 				CALLBACK_SCF(false);
 			} else if(dos.errorcode == 77) {
@@ -1027,8 +1033,9 @@ static Bitu DOS_21Handler(void) {
 	case 0x40:					/* WRITE Write to file or device */
 		{
 			Bit16u towrite=reg_cx;
-			MEM_BlockRead(SegPhys(ds)+reg_dx,dos_copybuf,towrite);
-			if (DOS_WriteFile(reg_bx,dos_copybuf,&towrite)) {
+			HostPt direct=DOS_GetDirectBuffer(reg_bx,SegPhys(ds)+reg_dx,towrite,false);
+			if (!direct) MEM_BlockRead(SegPhys(ds)+reg_dx,dos_copybuf,towrite);
+			if (DOS_WriteFile(reg_bx,direct ? direct : dos_copybuf,&towrite)) {
 				reg_ax=towrite;
 	   			CALLBACK_SCF(false);
 			} else {
@@ -2657,6 +2664,10 @@ public:
 
 		Section_prop *section=static_cast<Section_prop *>(configuration);
 		dos.host_time_flag = section->Get_bool("hosttime");
+		localfile_map = section->Get_bool("filemap");
+		dircache_watch = section->Get_bool("hostwatch");
+		imagedisk_cachesize = section->Get_int("imagecache");
+		imagedisk_flushdelay = section->Get_int("imageflush");
 	}
 	~DOS(){
 		for (Bit16u i=0;i<DOS_DRIVES;i++) delete Drives[i];
@@ -2665,6 +2676,63 @@ public:
 
 static DOS* test;
 
+static void DOS_DropStaleHandles(void) {
+	/* Handles in the restored process tables that lost their file are closed */
+	Bit16u mcb_segment=dos.firstMCB;
+	DOS_MCB mcb(mcb_segment);
+	for (;;) {
+		if (mcb.GetPSPSeg()==mcb_segment+1) {
+			DOS_PSP psp(mcb_segment+1);
+			for (Bit16u i=0;i<0xff;i++) {
+				Bit8u handle=psp.GetFileHandle(i);
+				if (handle!=0xff && (handle>=DOS_FILES || !Files[handle])) psp.SetFileHandle(i,0xff);
+			}
+		}
+		if (mcb.GetType()!=0x4d) break;
+		mcb_segment+=mcb.GetSize()+1;
+		mcb.SetPt(mcb_segment);
+	}
+}
+
+static void DOS_SaveState(SaveStream & stream) {
+	/* Host files can't be reopened in another session, only devices are kept */
+	if (!stream.loading) {
+		for (Bitu i=0;i<DOS_FILES;i++) {
+			if (Files[i] && !(Files[i]->GetInformation() & 0x8000)) {
+				LOG_MSG("Save state: %s is still open",Files[i]->GetName() ? Files[i]->GetName() : "a file");
+				stream.failed=true;
+				return;
+			}
+		}
+	}
+	/* Mounts stay as they are, only the current directories follow */
+	stream.Pod(dos);
+	for (Bitu i=0;i<DOS_DRIVES;i++) {
+		std::string dir;
+		if (!stream.loading && Drives[i]) dir=Drives[i]->curdir;
+		stream.String(dir);
+		if (stream.loading && !stream.failed && Drives[i] && dir.size()<DOS_PATHLENGTH) Drives[i]->SetDir(dir.c_str());
+	}
+	for (Bitu i=0;i<DOS_FILES;i++) {
+		std::string name;
+		Bits refs=0;
+		if (!stream.loading && Files[i]) {
+			if (Files[i]->GetName()) name=Files[i]->GetName();
+			refs=Files[i]->refCtr;
+		}
+		stream.String(name);
+		stream.Pod(refs);
+		if (!stream.loading || stream.failed || !Files[i]) continue;
+		/* Files of the session that is replaced and devices that differ go away */
+		if (!(Files[i]->GetInformation() & 0x8000) || name.empty() || !Files[i]->IsName(name.c_str())) {
+			Files[i]->Close();
+			delete Files[i];
+			Files[i]=0;
+		} else Files[i]->refCtr=refs;
+	}
+	if (stream.loading && !stream.failed) DOS_DropStaleHandles();
+}
+
 void DOS_ShutDown(Section* /*sec*/) {
 	delete test;
 }
@@ -2673,4 +2741,5 @@ void DOS_Init(Section* sec) {
 	test = new DOS(sec);
 	/* shutdown function */
 	sec->AddDestroyFunction(&DOS_ShutDown,false);
+	SAVESTATE_Register("dos",&DOS_SaveState);
 }
@@ -564,6 +564,14 @@ bool DOS_FindNext(void) {
 }
 
 
+HostPt DOS_GetDirectBuffer(Bit16u entry,PhysPt buf,Bit16u size,bool toguest) {
+	Bit32u handle=RealHandle(entry);
+	if (!size || handle>=DOS_FILES || !Files[handle] || !Files[handle]->IsOpen()) return 0;
+	/* Devices can run guest code during the transfer, they keep the copy buffer */
+	if (Files[handle]->GetInformation() & 0x8000) return 0;
+	return MEM_GetBlockHostPt(buf,size,toguest);
+}
+
 bool DOS_ReadFile(Bit16u entry,Bit8u * data,Bit16u * amount,bool fcb) {
 	Bit32u handle = fcb?entry:RealHandle(entry);
 	if (handle>=DOS_FILES) {
@@ -41,7 +41,14 @@
 #include <os2.h>
 #endif
 
+#if defined (LINUX)
+#define DIRCACHE_WATCH 1
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
 int fileInfoCounter = 0;
+bool dircache_watch;
 
 bool isKanji1(Bit8u chr) { return (chr >= 0x81 && chr <= 0x9f) || (chr >= 0xe0 && chr <= 0xfc); }
 bool isKanji2(Bit8u chr) { return (chr >= 0x40 && chr <= 0x7e) || (chr >= 0x80 && chr <= 0xfc); }
@@ -75,6 +82,8 @@ DOS_Drive_Cache::DOS_Drive_Cache(void) {
 	for (Bit32u i=0; i<MAX_OPENDIRS; i++) { dirSearch[i] = 0; dirFindFirst[i] = 0; };
 	SetDirSort(DIRALPHABETICAL);
 	updatelabel = true;
+	watchFd			= -1;
+	watchBusy		= false;
 }
 
 DOS_Drive_Cache::DOS_Drive_Cache(const char* path, DOS_Drive *drive) {
@@ -85,6 +94,8 @@ DOS_Drive_Cache::DOS_Drive_Cache(const char* path, DOS_Drive *drive) {
 	nextFreeFindFirst	= 0;
 	for (Bit32u i=0; i<MAX_OPENDIRS; i++) { dirSearch[i] = 0; dirFindFirst[i] = 0; };
 	SetDirSort(DIRALPHABETICAL);
+	watchFd			= -1;
+	watchBusy		= false;
 	SetBaseDir(path,drive);
 	updatelabel = true;
 }
@@ -92,6 +103,9 @@ DOS_Drive_Cache::DOS_Drive_Cache(const char* path, DOS_Drive *drive) {
 DOS_Drive_Cache::~DOS_Drive_Cache(void) {
 	Clear();
 	for (Bit32u i=0; i<MAX_OPENDIRS; i++) { DeleteFileInfo(dirFindFirst[i]); dirFindFirst[i]=0; };
+#if defined (DIRCACHE_WATCH)
+	if (watchFd>=0) close(watchFd);
+#endif
 }
 
 void DOS_Drive_Cache::Clear(void) {
@@ -216,7 +230,7 @@ void DOS_Drive_Cache::AddEntry(const char* path, bool checkExists) {
 		strcpy(file,pos+1);	
 		// Check if file already exists, then don't add new entry...
 		if (checkExists) {
-			if (GetLongName(dir,file)>=0) return;
+			if (FindEntry(dir,file)) return;
 		}
 
 		char sfile[DOS_NAMELENGTH];
@@ -239,6 +253,8 @@ void DOS_Drive_Cache::AddEntry(const char* path, bool checkExists) {
 }
 
 void DOS_Drive_Cache::DeleteEntry(const char* path, bool ignoreLastDir) {
+	// A deleted file leaves the rest of its directory cached
+	if (!ignoreLastDir && RemoveEntry(path)) return;
 	CacheOut(path,ignoreLastDir);
 	if (dirSearch[srchNr] && (dirSearch[srchNr]->nextEntry>0)) dirSearch[srchNr]->nextEntry--;
 
@@ -280,11 +296,105 @@ void DOS_Drive_Cache::CacheOut(const char* path, bool ignoreLastDir) {
 		DeleteFileInfo(dir->fileList[i]); dir->fileList[i] = 0;
 	}
 	// clear lists
+	UnwatchDir(dir);
 	dir->fileList.clear();
-	dir->longNameList.clear();
+	dir->shortIndex.clear();
+	dir->longIndex.clear();
+	dir->wineIndex.clear();
+	dir->wineIndexed = false;
+	dir->shortNrs.clear();
 	save_dir = 0;
 }
 
+bool DOS_Drive_Cache::RemoveEntry(const char* path) {
+	char expand[CROSS_LEN];
+	char file[CROSS_LEN];
+	const char* pos = strrchr(path,CROSS_FILESPLIT);
+	if (!pos) return false;
+	CFileInfo* dir = FindDirInfo(path,expand);
+	strcpy(file,pos+1);
+	CFileInfo* info = FindLongName(dir,file);
+	if (!info) info = FindEntry(dir,file);
+	// Directories may be referenced by searches, they are cached out as a whole
+	if (!info || info->isDir || EntryIndex(dir,info)<0) return false;
+	EraseEntry(dir,info);
+	return true;
+}
+
+void DOS_Drive_Cache::EraseEntry(CFileInfo* dir, CFileInfo* info) {
+	Bits index = EntryIndex(dir,info);
+	if (index<0) return;
+	dir->fileList.erase(dir->fileList.begin()+index);
+	UnindexEntry(dir,info);
+	// The number of a generated short name is free again
+	if (info->shortNr) {
+		std::map<std::string,Bitu>::iterator it = dir->shortNrs.find(std::string(info->shortname,strcspn(info->shortname,"~")));
+		if (it!=dir->shortNrs.end() && info->shortNr<it->second) it->second = info->shortNr;
+	}
+	if (info->isDir) save_dir = 0;
+	DeleteFileInfo(info);
+	// Open searches of the directory keep their place
+	if (dir->nextEntry>(Bitu)index) dir->nextEntry--;
+}
+
+void DOS_Drive_Cache::WatchDir(CFileInfo* dir, const char* path) {
+#if defined (DIRCACHE_WATCH)
+	if (!dircache_watch || dir->watch>=0) return;
+	if (watchFd<0) {
+		watchFd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+		if (watchFd<0) {
+			LOG_MSG("DIRCACHE: Can't watch host directories");
+			dircache_watch = false;
+			return;
+		}
+	}
+	// Without a watch, e.g. over the user limit, the directory only changes through DOS
+	dir->watch = inotify_add_watch(watchFd,path,IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_ONLYDIR);
+	if (dir->watch>=0) watches[dir->watch] = dir;
+#endif
+}
+
+void DOS_Drive_Cache::UnwatchDir(CFileInfo* dir) {
+#if defined (DIRCACHE_WATCH)
+	if (dir->watch<0) return;
+	inotify_rm_watch(watchFd,dir->watch);
+	watches.erase(dir->watch);
+	dir->watch = -1;
+#endif
+}
+
+void DOS_Drive_Cache::ProcessEvents(void) {
+#if defined (DIRCACHE_WATCH)
+	if (watchBusy) return;
+	watchBusy = true;
+	bool overflow = false;
+	Bit32u buffer[1024];
+	ssize_t len;
+	while ((len = read(watchFd,buffer,sizeof(buffer)))>0) {
+		for (char* pos = (char*)buffer; pos<(char*)buffer+len; ) {
+			const struct inotify_event* event = (const struct inotify_event*)pos;
+			pos += sizeof(struct inotify_event)+event->len;
+			if (event->mask & IN_Q_OVERFLOW) overflow = true;
+			// Events of directories that have been cached out since are dropped
+			std::map<int,CFileInfo*>::iterator it = watches.find(event->wd);
+			if (it==watches.end() || !event->len || overflow) continue;
+			CFileInfo* dir = it->second;
+			CFileInfo* info = FindLongName(dir,event->name);
+			if (event->mask & (IN_CREATE|IN_MOVED_TO)) {
+				// Files made through DOS are in already
+				if (info) continue;
+				CreateEntry(dir,event->name,"",(event->mask & IN_ISDIR)!=0);
+				Bits index = EntryIndex(dir,FindLongName(dir,event->name));
+				if (index>=0 && (Bitu)index<=dir->nextEntry) dir->nextEntry++;
+			} else if (info) EraseEntry(dir,info);
+		}
+	}
+	// Lost events leave no choice but to read everything again
+	if (overflow) EmptyCache();
+	watchBusy = false;
+#endif
+}
+
 bool DOS_Drive_Cache::IsCachedIn(CFileInfo* curDir) {
 	return (curDir->fileList.size()>0);
 }
@@ -295,82 +405,24 @@ bool DOS_Drive_Cache::GetShortName(const char* fullname, char* shortname) {
 	char expand[CROSS_LEN] = {0};
 	CFileInfo* curDir = FindDirInfo(fullname,expand);
 
-	std::vector<CFileInfo*>::size_type filelist_size = curDir->longNameList.size();
-	if (GCC_UNLIKELY(filelist_size<=0)) return false;
-
-	Bits low		= 0;
-	Bits high		= (Bits)(filelist_size-1);
-	Bits mid, res;
-
-	while (low<=high) {
-		mid = (low+high)/2;
-		res = strcmp(fullname,curDir->longNameList[mid]->orgname);
-		if (res>0)	low  = mid+1; else
-		if (res<0)	high = mid-1; 
-		else {
-			strcpy(shortname,curDir->longNameList[mid]->shortname);
-			return true;
-		};
-	}
-	return false;
+	CFileInfo* info = FindLongName(curDir,fullname);
+	if (!info) return false;
+	strcpy(shortname,info->shortname);
+	return true;
 }
 
-int DOS_Drive_Cache::CompareShortname(const char* compareName, const char* shortName) {
-	char const* cpos = strchr(shortName,'~');
-	if (cpos) {
-/* the following code is replaced as it's not safe when char* is 64 bits */
-/*		Bits compareCount1	= (int)cpos - (int)shortName;
-		char* endPos		= strchr(cpos,'.');
-		Bitu numberSize		= endPos ? int(endPos)-int(cpos) : strlen(cpos);
-		
-		char* lpos			= strchr(compareName,'.');
-		Bits compareCount2	= lpos ? int(lpos)-int(compareName) : strlen(compareName);
-		if (compareCount2>8) compareCount2 = 8;
-
-		compareCount2 -= numberSize;
-		if (compareCount2>compareCount1) compareCount1 = compareCount2;
-*/
-		size_t compareCount1 = strcspn(shortName,"~");
-		size_t numberSize    = strcspn(cpos,".");
-		size_t compareCount2 = strcspn(compareName,".");
-		if(compareCount2 > 8) compareCount2 = 8;
-		/* We want 
-		 * compareCount2 -= numberSize;
-		 * if (compareCount2>compareCount1) compareCount1 = compareCount2;
-		 * but to prevent negative numbers: 
-		 */
-		if(compareCount2 > compareCount1 + numberSize)
-			compareCount1 = compareCount2 - numberSize;
-		return strncmp(compareName,shortName,compareCount1);
-	}
-	return strcmp(compareName,shortName);
-}
-
-Bitu DOS_Drive_Cache::CreateShortNameID(CFileInfo* curDir, const char* name) {
-	std::vector<CFileInfo*>::size_type filelist_size = curDir->longNameList.size();
-	if (GCC_UNLIKELY(filelist_size<=0)) return 1;	// shortener IDs start with 1
-
-	Bitu foundNr	= 0;	
-	Bits low		= 0;
-	Bits high		= (Bits)(filelist_size-1);
-	Bits mid, res;
-
-	while (low<=high) {
-		mid = (low+high)/2;
-		res = CompareShortname(name,curDir->longNameList[mid]->shortname);
-		
-		if (res>0)	low  = mid+1; else
-		if (res<0)	high = mid-1; 
-		else {
-			// any more same x chars in next entries ?	
-			do {
-				foundNr = curDir->longNameList[mid]->shortNr;
-				mid++;
-			} while((Bitu)mid<curDir->longNameList.size() && (CompareShortname(name,curDir->longNameList[mid]->shortname)==0));
-			break;
-		};
-	}
-	return foundNr+1;
+Bitu DOS_Drive_Cache::CreateShortNameID(CFileInfo* curDir, const char* shortName, Bitu nr) {
+	// All numbers of a stem, the part in front of the '~', below its hint are taken
+	Bitu& hint = curDir->shortNrs[std::string(shortName,strcspn(shortName,"~"))];
+	if (hint==0) hint = nr;
+	if (nr<hint) return hint;
+	// Names of host files and of other stems can still be in the way
+	char name[CROSS_LEN];
+	strcpy(name,shortName);
+	RemoveTrailingDot(name);
+	bool taken = FindShortName(curDir,name)!=0;
+	if (nr==hint) hint = nr+1;
+	return taken ? nr+1 : nr;
 }
 
 bool DOS_Drive_Cache::RemoveTrailingDot(char* shortname) {
@@ -439,43 +491,120 @@ static Bits wine_hash_short_file_name( char* name, char* buffer )
 }
 #endif
 
-Bits DOS_Drive_Cache::GetLongName(CFileInfo* curDir, char* shortName) {
-	std::vector<CFileInfo*>::size_type filelist_size = curDir->fileList.size();
-	if (GCC_UNLIKELY(filelist_size<=0)) return -1;
+static Bitu NameHash(const char* name) {
+	Bit32u hash = 2166136261u;
+	while (*name) hash = (hash ^ (Bit8u)*name++) * 16777619u;
+	return hash;
+}
 
-	// Remove dot, if no extension...
-	RemoveTrailingDot(shortName);
-	// Search long name and return array number of element
-	Bits low	= 0;
-	Bits high	= (Bits)(filelist_size-1);
-	Bits mid,res;
-	while (low<=high) {
-		mid = (low+high)/2;
-		res = strcmp(shortName,curDir->fileList[mid]->shortname);
-		if (res>0)	low  = mid+1; else
-		if (res<0)	high = mid-1; else
-		{	// Found
-			strcpy(shortName,curDir->fileList[mid]->orgname);
-			return mid;
-		};
+static void LinkName(std::vector<DOS_Drive_Cache::CFileInfo*>& index, DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::CFileInfo::* chain, const char* name, DOS_Drive_Cache::CFileInfo* info) {
+	DOS_Drive_Cache::CFileInfo*& head = index[NameHash(name)&(index.size()-1)];
+	info->*chain = head;
+	head = info;
+}
+
+static void UnlinkName(std::vector<DOS_Drive_Cache::CFileInfo*>& index, DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::CFileInfo::* chain, const char* name, DOS_Drive_Cache::CFileInfo* info) {
+	if (index.empty()) return;
+	DOS_Drive_Cache::CFileInfo** link = &index[NameHash(name)&(index.size()-1)];
+	while (*link && *link!=info) link = &((*link)->*chain);
+	if (*link) *link = info->*chain;
+	info->*chain = 0;
+}
+
+void DOS_Drive_Cache::IndexEntry(CFileInfo* dir, CFileInfo* info) {
+	// Grow the index along with the directory
+	if (dir->fileList.size()>dir->shortIndex.size()) {
+		RebuildIndex(dir);
+		return;
 	}
+	LinkName(dir->shortIndex,&CFileInfo::shortChain,info->shortname,info);
+	LinkName(dir->longIndex,&CFileInfo::longChain,info->orgname,info);
 #ifdef WINE_DRIVE_SUPPORT
-	if (strlen(shortName) < 8 || shortName[4] != '~' || shortName[5] == '.' || shortName[6] == '.' || shortName[7] == '.') return -1; // not available
+	if (dir->wineIndexed) {
+		char buff[CROSS_LEN];
+		buff[wine_hash_short_file_name(info->orgname,buff)] = 0;
+		LinkName(dir->wineIndex,&CFileInfo::wineChain,buff,info);
+	}
+#endif
+}
+
+void DOS_Drive_Cache::UnindexEntry(CFileInfo* dir, CFileInfo* info) {
+	UnlinkName(dir->shortIndex,&CFileInfo::shortChain,info->shortname,info);
+	UnlinkName(dir->longIndex,&CFileInfo::longChain,info->orgname,info);
+#ifdef WINE_DRIVE_SUPPORT
+	if (dir->wineIndexed) {
+		char buff[CROSS_LEN];
+		buff[wine_hash_short_file_name(info->orgname,buff)] = 0;
+		UnlinkName(dir->wineIndex,&CFileInfo::wineChain,buff,info);
+	}
+#endif
+}
+
+void DOS_Drive_Cache::RebuildIndex(CFileInfo* dir) {
+	Bitu size = 16;
+	while (size<dir->fileList.size()*2) size *= 2;
+	dir->shortIndex.assign(size,(CFileInfo*)0);
+	dir->longIndex.assign(size,(CFileInfo*)0);
+	if (dir->wineIndexed) dir->wineIndex.assign(size,(CFileInfo*)0);
+	for (Bitu i=0; i<dir->fileList.size(); i++) IndexEntry(dir,dir->fileList[i]);
+}
+
+DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindShortName(CFileInfo* dir, const char* shortName) {
+	if (dir->shortIndex.empty()) return 0;
+	for (CFileInfo* info = dir->shortIndex[NameHash(shortName)&(dir->shortIndex.size()-1)]; info; info = info->shortChain)
+		if (!strcmp(shortName,info->shortname)) return info;
+	return 0;
+}
+
+DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindLongName(CFileInfo* dir, const char* longName) {
+	if (dir->longIndex.empty()) return 0;
+	for (CFileInfo* info = dir->longIndex[NameHash(longName)&(dir->longIndex.size()-1)]; info; info = info->longChain)
+		if (!strcmp(longName,info->orgname)) return info;
+	return 0;
+}
+
+DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindWineName(CFileInfo* dir, const char* shortName) {
+#ifdef WINE_DRIVE_SUPPORT
+	if (strlen(shortName) < 8 || shortName[4] != '~' || shortName[5] == '.' || shortName[6] == '.' || shortName[7] == '.') return 0; // not available
 	// else it's most likely a Wine style short name ABCD~###, # = not dot  (length at least 8) 
-	// The above test is rather strict as the following loop can be really slow if filelist_size is large.
+	// Their index is only set up for directories where they are used.
+	if (!dir->wineIndexed) {
+		dir->wineIndexed = true;
+		RebuildIndex(dir);
+	}
 	char buff[CROSS_LEN];
-	for (Bitu i = 0; i < filelist_size; i++) {
-		res = wine_hash_short_file_name(curDir->fileList[i]->orgname,buff);
-		buff[res] = 0;
-		if (!strcmp(shortName,buff)) {	
-			// Found
-			strcpy(shortName,curDir->fileList[i]->orgname);
-			return (Bits)i;
-		}
+	for (CFileInfo* info = dir->wineIndex[NameHash(shortName)&(dir->wineIndex.size()-1)]; info; info = info->wineChain) {
+		buff[wine_hash_short_file_name(info->orgname,buff)] = 0;
+		if (!strcmp(shortName,buff)) return info;
 	}
 #endif
 	// not available
-	return -1;
+	return 0;
+}
+
+DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindEntry(CFileInfo* curDir, char* shortName) {
+	if (GCC_UNLIKELY(curDir->fileList.empty())) return 0;
+
+	// Remove dot, if no extension...
+	RemoveTrailingDot(shortName);
+	CFileInfo* info = FindShortName(curDir,shortName);
+	if (!info) info = FindWineName(curDir,shortName);
+	if (info) strcpy(shortName,info->orgname);
+	return info;
+}
+
+Bits DOS_Drive_Cache::EntryIndex(CFileInfo* dir, CFileInfo* info) {
+	if (!info) return -1;
+	// The list is sorted by short name
+	std::vector<CFileInfo*>::iterator it = std::lower_bound(dir->fileList.begin(),dir->fileList.end(),info,SortByName);
+	while (it!=dir->fileList.end() && *it!=info) ++it;
+	if (it==dir->fileList.end()) return -1;
+	return (Bits)(it - dir->fileList.begin());
+}
+
+Bits DOS_Drive_Cache::GetLongName(CFileInfo* curDir, char* shortName) {
+	// Return array number of element
+	return EntryIndex(curDir,FindEntry(curDir,shortName));
 }
 
 bool DOS_Drive_Cache::RemoveSpaces(char* str) {
@@ -533,98 +662,81 @@ void DOS_Drive_Cache::CreateShortName(CFileInfo* curDir, CFileInfo* info) {
 	if (!createShort) {
 		char buffer[CROSS_LEN];
 		strcpy(buffer,tmpName);
-		createShort = (GetLongName(curDir,buffer)>=0);
+		createShort = (FindEntry(curDir,buffer)!=0);
 	}
 
 	if (createShort) {
-		// Create number
-		char buffer[8];
-		info->shortNr = CreateShortNameID(curDir,tmpName);
-		sprintf(buffer,"%d",info->shortNr);
-		// Copy first letters
-		Bits tocopy = 0;
-		size_t buflen = strlen(buffer);
+		Bitu nr = 1;
+		for (;;) {
+			// Create number
+			char buffer[8];
+			sprintf(buffer,"%d",(int)nr);
+			// Copy first letters
+			Bits tocopy = 0;
+			size_t buflen = strlen(buffer);
 #if defined(WIN32)
-		if (len+buflen+1>8)	tocopy = (Bits)(8 - buflen - 1);
-		else				tocopy = len;
-		// Shift-JIS
-		bool kanji_flag = false;
-		Bits ct = 0;
-		while(ct < tocopy) {
-			if(kanji_flag) {
-				kanji_flag = false;
-			} else {
-				if(isKanji1((unsigned char)tmpName[ct])) {
-					if(ct >= tocopy - 1) {
-						break;
+			if (len+buflen+1>8)	tocopy = (Bits)(8 - buflen - 1);
+			else				tocopy = len;
+			// Shift-JIS
+			bool kanji_flag = false;
+			Bits ct = 0;
+			while(ct < tocopy) {
+				if(kanji_flag) {
+					kanji_flag = false;
+				} else {
+					if(isKanji1((unsigned char)tmpName[ct])) {
+						if(ct >= tocopy - 1) {
+							break;
+						}
+						kanji_flag = true;
 					}
-					kanji_flag = true;
 				}
+				info->shortname[ct] = tmpName[ct];
+				ct++;
 			}
-			info->shortname[ct] = tmpName[ct];
-			ct++;
-		}
-		info->shortname[ct] = 0;
+			info->shortname[ct] = 0;
 #elif defined(LINUX)
-		if (len+buflen+1>8)	tocopy = (Bits)(6 - buflen - 1);
-		else				tocopy = len;
-		bool kanji_flag = false;
-		char temp_name[CROSS_LEN];
-		Bits ct = 0;
-		while(ct < tocopy) {
-			if(kanji_flag) {
-				kanji_flag = false;
-			} else {
-				if(isKanji1((unsigned char)sjis[ct])) {
-					if(ct >= tocopy - 1) {
-						break;
+			if (len+buflen+1>8)	tocopy = (Bits)(6 - buflen - 1);
+			else				tocopy = len;
+			bool kanji_flag = false;
+			char temp_name[CROSS_LEN];
+			Bits ct = 0;
+			while(ct < tocopy) {
+				if(kanji_flag) {
+					kanji_flag = false;
+				} else {
+					if(isKanji1((unsigned char)sjis[ct])) {
+						if(ct >= tocopy - 1) {
+							break;
+						}
+						kanji_flag = true;
 					}
-					kanji_flag = true;
 				}
+				temp_name[ct] = sjis[ct];
+				ct++;
 			}
-			temp_name[ct] = sjis[ct];
-			ct++;
-		}
-		temp_name[ct] = 0;
-		sjis_to_utf8_copy(info->shortname, temp_name, DOS_FCBNAME);
+			temp_name[ct] = 0;
+			sjis_to_utf8_copy(info->shortname, temp_name, DOS_FCBNAME);
 #else
-		safe_strncpy(info->shortname,tmpName,tocopy+1);
+			safe_strncpy(info->shortname,tmpName,tocopy+1);
 #endif
-		// Copy number
-		strcat(info->shortname,"~");
-		strcat(info->shortname,buffer);
-		// Add (and cut) Extension, if available
-		if (pos) {
-			// Step to last extension...
-			pos = strrchr(tmpName, '.');
-			// add extension
-			strncat(info->shortname,pos,4);
-			info->shortname[DOS_NAMELENGTH] = 0;
-		}
-
-		// keep list sorted for CreateShortNameID to work correctly
-		if (curDir->longNameList.size()>0) {
-			if (!(strcmp(info->shortname,curDir->longNameList.back()->shortname)<0)) {
-				// append at end of list
-				curDir->longNameList.push_back(info);
-			} else {
-				// look for position where to insert this element
-				bool found=false;
-				std::vector<CFileInfo*>::iterator it;
-				for (it=curDir->longNameList.begin(); it!=curDir->longNameList.end(); ++it) {
-					if (strcmp(info->shortname,(*it)->shortname)<0) {
-						found = true;
-						break;
-					}
-				}
-				// Put it in longname list...
-				if (found) curDir->longNameList.insert(it,info);
-				else curDir->longNameList.push_back(info);
+			// Copy number
+			strcat(info->shortname,"~");
+			strcat(info->shortname,buffer);
+			// Add (and cut) Extension, if available
+			if (pos) {
+				// Step to last extension...
+				pos = strrchr(tmpName, '.');
+				// add extension
+				strncat(info->shortname,pos,4);
+				info->shortname[DOS_NAMELENGTH] = 0;
 			}
-		} else {
-			// empty file list, append
-			curDir->longNameList.push_back(info);
+			// Numbers that are taken move on to a free one
+			Bitu next = CreateShortNameID(curDir,info->shortname,nr);
+			if (next==nr) break;
+			nr = next;
 		}
+		info->shortNr = nr;
 	} else {
 		strcpy(info->shortname,tmpName);
 	}
@@ -632,6 +744,9 @@ void DOS_Drive_Cache::CreateShortName(CFileInfo* curDir, CFileInfo* info) {
 }
 
 DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindDirInfo(const char* path, char* expandedPath) {
+	// Bring the cache up to date with the host first
+	if (watchFd>=0) ProcessEvents();
+
 	// statics
 	static char	split[2] = { CROSS_FILESPLIT,0 };
 	
@@ -676,7 +791,7 @@ DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindDirInfo(const char* path, char*
 		else	 { strcpy(dir,start); };
  
 		// Path found
-		Bits nextDir = GetLongName(curDir,dir);
+		CFileInfo* nextDir = FindEntry(curDir,dir);
 		strcat(expandedPath,dir);
 
 		// Error check
@@ -685,8 +800,8 @@ DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindDirInfo(const char* path, char*
 		};
 */
 		// Follow Directory
-		if ((nextDir>=0) && curDir->fileList[nextDir]->isDir) {
-			curDir = curDir->fileList[nextDir];
+		if (nextDir && nextDir->isDir) {
+			curDir = nextDir;
 			strcpy (curDir->orgname,dir);
 			if (!IsCachedIn(curDir)) {
 				if (OpenDir(curDir,expandedPath,id)) {
@@ -769,30 +884,9 @@ void DOS_Drive_Cache::CreateEntry(CFileInfo* dir, const char* name, const char*
 	// Check for long filenames...
 	if (sname[0]==0) CreateShortName(dir, info);		
 
-	bool found = false;
-
-	// keep list sorted (so GetLongName works correctly, used by CreateShortName in this routine)
-	if (dir->fileList.size()>0) {
-		if (!(strcmp(info->shortname,dir->fileList.back()->shortname)<0)) {
-			// append at end of list
-			dir->fileList.push_back(info);
-		} else {
-			// look for position where to insert this element
-			std::vector<CFileInfo*>::iterator it;
-			for (it=dir->fileList.begin(); it!=dir->fileList.end(); ++it) {
-				if (strcmp(info->shortname,(*it)->shortname)<0) {
-					found = true;
-					break;
-				}
-			}
-			// Put file in lists
-			if (found) dir->fileList.insert(it,info);
-			else dir->fileList.push_back(info);
-		}
-	} else {
-		// empty file list, append
-		dir->fileList.push_back(info);
-	}
+	// keep list sorted by short name, it is the order of the directory listing
+	dir->fileList.insert(std::upper_bound(dir->fileList.begin(),dir->fileList.end(),info,SortByName),info);
+	IndexEntry(dir,info);
 }
 
 void DOS_Drive_Cache::CopyEntry(CFileInfo* dir, CFileInfo* from) {
@@ -809,8 +903,12 @@ void DOS_Drive_Cache::CopyEntry(CFileInfo* dir, CFileInfo* from) {
 bool DOS_Drive_Cache::ReadDir(Bit16u id, char* &result, char * &lresult) {
 	// shouldnt happen...
 	if (id>MAX_OPENDIRS) return false;
+	// the directory may have been removed on the host since it was opened
+	if (!dirSearch[id]) return false;
 
 	if (!IsCachedIn(dirSearch[id])) {
+		// Watch before reading, nothing made in between gets lost
+		WatchDir(dirSearch[id],dirPath);
 		// Try to open directory
 		dir_information* dirp = (dir_information*)(
 #ifdef WIN32
@@ -956,6 +1054,7 @@ void DOS_Drive_Cache::ClearFileInfo(CFileInfo *dir) {
 		dirSearch[dir->id] = 0;
 		dir->id = MAX_OPENDIRS;
 	}
+	UnwatchDir(dir);
 }
 
 void DOS_Drive_Cache::DeleteFileInfo(CFileInfo *dir) {
@@ -1048,6 +1048,8 @@ bool fatDrive::isWriteProtected(void) {
 
 
 Bits fatDrive::UnMount(void) {
+	/* The disk can live on as a BIOS drive */
+	loadedDisk->Flush();
 	delete this;
 	return 0;
 }
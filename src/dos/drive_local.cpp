@@ -39,6 +39,18 @@
 #if defined(WIN32)
 #define	fseek	_fseeki64
 #define	ftell	_ftelli64
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <signal.h>
+#include <setjmp.h>
+/* Transfers from this size on bypass the stdio buffer */
+#define LOCALFILE_DIRECT	4096
+/* Files opened for reading from this size on are mapped */
+#define LOCALFILE_MAP		(64*1024)
+#define LOCALFILE_AHEAD		(256*1024)
+#define LOCALFILE_STREAK	4
 #endif
 
 #if defined(WIN32)
@@ -64,12 +76,38 @@ public:
 	bool UpdateDateTimeFromHost(void);   
 	void FlagReadOnlyMedium(void);
 	void Flush(void);
+	void DropMapping(void);
 private:
 	FILE * fhandle;
 	bool read_only_medium;
 	enum { NONE,READ,WRITE } last_action;
+#if defined(LOCALFILE_MAP)
+	bool MapFile(void);
+	void UnmapFile(void);
+	bool ReadMapped(Bit8u * data,Bit16u * size);
+	void AdviseAccess(Bit32u pos,Bit16u size);
+	Bit8u * map_base;
+	Bit32u map_size,map_pos,map_next,map_ahead;
+	Bitu map_seq,map_rand;
+	int map_advice;
+	bool map_tried;
+#endif
 };
 
+bool localfile_map;
+
+/* Other handles of a file see changes made through this one */
+static void LOCALFILE_SyncHandles(Bit8u drive,const char * name,DOS_File * self,bool unmap) {
+	for (Bit8u i=0;i<DOS_FILES;i++) {
+		if (Files[i] && Files[i]!=self && Files[i]->IsOpen() && Files[i]->GetDrive()==drive && Files[i]->IsName(name)) {
+			localFile * lfp=dynamic_cast<localFile*>(Files[i]);
+			if (!lfp) continue;
+			lfp->Flush();
+			if (unmap) lfp->DropMapping();
+		}
+	}
+}
+
 enum {
 	UTF8ERR_INVALID=-1,
 	UTF8ERR_NO_ROOM=-2
@@ -540,6 +578,15 @@ bool localDrive::FileCreate(DOS_File * * file,char * name,Bit16u /*attributes*/)
 	}
    
 	if(!existing_file) dirCache.AddEntry(newname, true);
+	else {
+		/* The file was truncated under any mapping of it */
+		for (Bit8u i=0;i<DOS_DRIVES;i++) {
+			if (Drives[i]==this) {
+				LOCALFILE_SyncHandles(i,name,0,true);
+				break;
+			}
+		}
+	}
 	/* Make the 16 bit device information */
 	*file=new localFile(name,hand);
 	(*file)->flags=OPEN_READWRITE;
@@ -568,19 +615,13 @@ bool localDrive::FileOpen(DOS_File * * file,char * name,Bit32u flags) {
 
 	//Flush the buffer of handles for the same file. (Betrayal in Antara)
 	Bit8u i,drive=DOS_DRIVES;
-	localFile *lfp;
 	for (i=0;i<DOS_DRIVES;i++) {
 		if (Drives[i]==this) {
 			drive=i;
 			break;
 		}
 	}
-	for (i=0;i<DOS_FILES;i++) {
-		if (Files[i] && Files[i]->IsOpen() && Files[i]->GetDrive()==drive && Files[i]->IsName(name)) {
-			lfp=dynamic_cast<localFile*>(Files[i]);
-			if (lfp) lfp->Flush();
-		}
-	}
+	LOCALFILE_SyncHandles(drive,name,0,(flags&0xf)!=OPEN_READ && (flags&0xf)!=OPEN_READ_NO_MOD);
 
 	FILE * hand = NULL;
 #if defined(_MSC_VER) && (_MSC_VER >= 1900)
@@ -1268,7 +1309,23 @@ bool localFile::Read(Bit8u * data,Bit16u * size) {
 	}
 	if (last_action==WRITE) fseek(fhandle,ftell(fhandle),SEEK_SET);
 	last_action=READ;
-	*size=(Bit16u)fread(data,1,*size,fhandle);
+#if defined(LOCALFILE_MAP)
+	if (!ReadMapped(data,size))
+#endif
+	{
+#if defined(LOCALFILE_DIRECT)
+		if (*size>=LOCALFILE_DIRECT) {
+			/* Read straight into the buffer and move the stream past it */
+			long pos=ftell(fhandle);
+			ssize_t done=pos<0 ? -1 : pread(fileno(fhandle),data,*size,pos);
+			if (done>=0) {
+				fseek(fhandle,pos+done,SEEK_SET);
+				*size=(Bit16u)done;
+			} else *size=(Bit16u)fread(data,1,*size,fhandle);
+		} else
+#endif
+		*size=(Bit16u)fread(data,1,*size,fhandle);
+	}
 	/* Fake harddrive motion. Inspector Gadget with soundblaster compatible */
 	/* Same for Igor */
 	/* hardrive motion => unmask irq 2. Only do it when it's masked as unmasking is realitively heavy to emulate */
@@ -1282,13 +1339,30 @@ bool localFile::Write(Bit8u * data,Bit16u * size) {
 		DOS_SetError(DOSERR_ACCESS_DENIED);
 		return false;
 	}
+#if defined(LOCALFILE_MAP)
+	UnmapFile();
+#endif
 	if (last_action==READ) fseek(fhandle,ftell(fhandle),SEEK_SET);
 	last_action=WRITE;
 	if(*size==0){  
+		LOCALFILE_SyncHandles(GetDrive(),name,this,true);
         return (!ftruncate(fileno(fhandle),(Bit32u)ftell(fhandle)));
     }
     else 
     {
+#if defined(LOCALFILE_DIRECT)
+		if (*size>=LOCALFILE_DIRECT) {
+			/* The stream has nothing pending after the flush */
+			fflush(fhandle);
+			long pos=ftell(fhandle);
+			ssize_t done=pos<0 ? -1 : pwrite(fileno(fhandle),data,*size,pos);
+			if (done>=0) {
+				fseek(fhandle,pos+done,SEEK_SET);
+				*size=(Bit16u)done;
+				return true;
+			}
+		}
+#endif
 		*size=(Bit16u)fwrite(data,1,*size,fhandle);
 		return true;
     }
@@ -1304,6 +1378,18 @@ bool localFile::Seek(Bit32u * pos,Bit32u type) {
 	//TODO Give some doserrorcode;
 		return false;//ERROR
 	}
+#if defined(LOCALFILE_MAP)
+	if (map_base) {
+		/* Same outcome as the stream, out of range moves to the end */
+		Bit64s newpos=*reinterpret_cast<Bit32s*>(pos);
+		if (seektype==SEEK_CUR) newpos+=map_pos;
+		else if (seektype==SEEK_END) newpos+=map_size;
+		map_pos=(newpos<0 || newpos>0x7fffffff) ? map_size : (Bit32u)newpos;
+		*pos=map_pos;
+		last_action=NONE;
+		return true;
+	}
+#endif
 	int ret=fseek(fhandle,*reinterpret_cast<Bit32s*>(pos),seektype);
 	if (ret!=0) {
 		// Out of file range, pretend everythings ok 
@@ -1324,6 +1410,9 @@ bool localFile::Seek(Bit32u * pos,Bit32u type) {
 bool localFile::Close() {
 	// only close if one reference left
 	if (refCtr==1) {
+#if defined(LOCALFILE_MAP)
+		if(fhandle) UnmapFile();
+#endif
 		if(fhandle) fclose(fhandle);
 		fhandle = 0;
 		open = false;
@@ -1344,6 +1433,10 @@ localFile::localFile(const char* _name, FILE * handle) {
 	attr=DOS_ATTR_ARCHIVE;
 	last_action=NONE;
 	read_only_medium=false;
+#if defined(LOCALFILE_MAP)
+	map_base=0;
+	map_tried=false;
+#endif
 
 	name=0;
 	SetName(_name);
@@ -1374,6 +1467,133 @@ void localFile::Flush(void) {
 	}
 }
 
+void localFile::DropMapping(void) {
+#if defined(LOCALFILE_MAP)
+	/* Mapped again with the new size on the next read */
+	UnmapFile();
+	map_tried=false;
+#endif
+}
+
+#if defined(LOCALFILE_MAP)
+/* A file truncated on the host raises SIGBUS when the lost pages are read,
+ * the copy out of a mapping jumps back and the read goes through stdio */
+static sigjmp_buf localfile_fault;
+static const Bit8u * volatile localfile_fault_start;
+static const Bit8u * volatile localfile_fault_end;
+static struct sigaction localfile_oldbus;
+
+static void LOCALFILE_BusHandler(int sig,siginfo_t * info,void * context) {
+	const Bit8u * addr=(const Bit8u *)info->si_addr;
+	if (addr>=localfile_fault_start && addr<localfile_fault_end) siglongjmp(localfile_fault,1);
+	/* Not ours, the fault comes back with the previous handler */
+	sigaction(SIGBUS,&localfile_oldbus,0);
+}
+
+static bool LOCALFILE_CopyMapped(Bit8u * data,const Bit8u * src,Bitu size) {
+	static bool installed=false;
+	if (!installed) {
+		struct sigaction action;
+		memset(&action,0,sizeof(action));
+		action.sa_sigaction=LOCALFILE_BusHandler;
+		sigemptyset(&action.sa_mask);
+		/* Not blocked in the handler, the jump out doesn't restore the mask */
+		action.sa_flags=SA_SIGINFO|SA_NODEFER;
+		if (sigaction(SIGBUS,&action,&localfile_oldbus)) return false;
+		installed=true;
+	}
+	if (sigsetjmp(localfile_fault,0)) {
+		localfile_fault_start=localfile_fault_end=0;
+		return false;
+	}
+	localfile_fault_start=src;
+	localfile_fault_end=src+size;
+	memcpy(data,src,size);
+	localfile_fault_start=localfile_fault_end=0;
+	return true;
+}
+
+bool localFile::MapFile(void) {
+	map_tried=true;
+	if (!localfile_map || ((flags&0xf)!=OPEN_READ && (flags&0xf)!=OPEN_READ_NO_MOD)) return false;
+	struct stat temp_stat;
+	if (fstat(fileno(fhandle),&temp_stat) || !S_ISREG(temp_stat.st_mode)) return false;
+	if (temp_stat.st_size<LOCALFILE_MAP || (Bit64s)temp_stat.st_size>0x7fffffff) return false;
+	long pos=ftell(fhandle);
+	if (pos<0) return false;
+	void * base=mmap(0,(size_t)temp_stat.st_size,PROT_READ,MAP_SHARED,fileno(fhandle),0);
+	if (base==MAP_FAILED) return false;
+	map_base=(Bit8u *)base;
+	map_size=(Bit32u)temp_stat.st_size;
+	map_pos=map_next=map_ahead=(Bit32u)pos;
+	map_seq=map_rand=0;
+	map_advice=MADV_NORMAL;
+	return true;
+}
+
+void localFile::UnmapFile(void) {
+	if (!map_base) return;
+	munmap(map_base,map_size);
+	map_base=0;
+	/* The stream carries on where the mapping left off */
+	fseek(fhandle,map_pos,SEEK_SET);
+}
+
+bool localFile::ReadMapped(Bit8u * data,Bit16u * size) {
+	if (!map_tried) MapFile();
+	if (!map_base) return false;
+	Bit32u avail=map_pos<map_size ? map_size-map_pos : 0;
+	if (*size>avail) {
+		/* Reads past the end check if the file has grown since */
+		struct stat temp_stat;
+		if (fstat(fileno(fhandle),&temp_stat) || temp_stat.st_size!=(off_t)map_size) {
+			DropMapping();
+			if (!MapFile()) return false;
+			avail=map_pos<map_size ? map_size-map_pos : 0;
+		}
+		if (*size>avail) *size=(Bit16u)avail;
+	}
+	AdviseAccess(map_pos,*size);
+	if (!LOCALFILE_CopyMapped(data,map_base+map_pos,*size)) {
+		/* Shrunk on the host, the stream returns what is left */
+		DropMapping();
+		return false;
+	}
+	map_pos+=*size;
+	return true;
+}
+
+void localFile::AdviseAccess(Bit32u pos,Bit16u size) {
+	/* A few reads in a row decide between sequential and random access */
+	if (pos==map_next) {
+		if (map_seq<LOCALFILE_STREAK) map_seq++;
+		map_rand=0;
+	} else {
+		if (map_rand<LOCALFILE_STREAK) map_rand++;
+		map_seq=0;
+	}
+	map_next=pos+size;
+	int advice=map_advice;
+	if (map_seq>=LOCALFILE_STREAK) advice=MADV_SEQUENTIAL;
+	else if (map_rand>=LOCALFILE_STREAK) advice=MADV_RANDOM;
+	if (advice!=map_advice) {
+		map_advice=advice;
+		madvise(map_base,map_size,advice);
+#if defined(POSIX_FADV_SEQUENTIAL)
+		posix_fadvise(fileno(fhandle),0,0,advice==MADV_SEQUENTIAL ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_RANDOM);
+#endif
+		map_ahead=pos;
+	}
+	/* Keep the pages ahead of a stream on their way in */
+	if (map_advice==MADV_SEQUENTIAL && map_next>=map_ahead && map_next<map_size) {
+		Bit32u start=map_next & ~(Bit32u)(sysconf(_SC_PAGESIZE)-1);
+		Bit32u len=map_size-start<LOCALFILE_AHEAD ? map_size-start : LOCALFILE_AHEAD;
+		madvise(map_base+start,len,MADV_WILLNEED);
+		map_ahead=start+len/2;
+	}
+}
+#endif
+
 
 // ********************************************
 // CDROM DRIVE
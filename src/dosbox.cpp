@@ -26,6 +26,12 @@
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include <math.h>
+#include <time.h>
+#if defined(WIN32)
+#include <windows.h>
+#include <mmsystem.h>
+#endif
 #include "dosbox.h"
 #include "debug.h"
 #include "cpu.h"
@@ -49,6 +55,7 @@
 #include "j3.h"
 #include "dosv.h"
 #include "jfont.h"
+#include "savestate.h"
 
 Config * control;
 MachineType machine;
@@ -111,6 +118,7 @@ void TIMER_Init(Section*);
 void BIOS_Init(Section*);
 void DEBUG_Init(Section*);
 void CMOS_Init(Section*);
+void SAVESTATE_Init(Section*);
 
 void MSCDEX_Init(Section*);
 void DRIVES_Init(Section*);
@@ -155,6 +163,7 @@ static Bitu Normal_Loop(void) {
 #endif
 		} else {
 			GFX_Events();
+			SAVESTATE_Run();
 			if (ticksRemain>0) {
 				TIMER_AddTick();
 				ticksRemain--;
@@ -166,7 +175,146 @@ static Bitu Normal_Loop(void) {
 //For trying other delays
 #define wrap_delay(a) SDL_Delay(a)
 
+/* Precise pacing: emulated milliseconds are scheduled against a microsecond
+   host clock, and auto cycles follow a smoothed controller that is updated
+   every PACING_WINDOW microseconds. */
+#define PACING_WINDOW 50000
+#define PACING_BACKLOG 20
+#define PACING_SPIN 200
+
+static struct {
+	bool precise;
+	Bit64u last;				// host time up to which ticks were handed out
+	Bit64u window_start;
+	Bit64u slept;				// time slept in the current window
+	Bit32u scheduled;			// ticksScheduled as last seen
+	double error[2];			// previous controller errors
+	double smooth;
+} pacing;
+
+static Bit64u PACING_Now(void) {
+#if defined(WIN32)
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER count;
+	if (!freq.QuadPart) QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (Bit64u)(count.QuadPart/freq.QuadPart)*1000000+(Bit64u)(count.QuadPart%freq.QuadPart)*1000000/freq.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (Bit64u)ts.tv_sec*1000000+(Bit64u)ts.tv_nsec/1000;
+#else
+	return (Bit64u)GetTicks()*1000;
+#endif
+}
+
+static void PACING_Sleep(Bit64u us) {
+#if defined(WIN32)
+	/* With a 1 ms timer period Sleep(1) lasts about a millisecond, the
+	   schedule absorbs the overshoot. Only very short waits are spun. */
+	static bool period=false;
+	if (!period) {
+		timeBeginPeriod(1);
+		period=true;
+	}
+	Bit64u end=PACING_Now()+us;
+	if (us>=PACING_SPIN) Sleep(1);
+	while (PACING_Now()<end) Sleep(0);
+#else
+	struct timespec ts;
+	ts.tv_sec=(time_t)(us/1000000);
+	ts.tv_nsec=(long)(us%1000000)*1000;
+	nanosleep(&ts,0);
+#endif
+}
+
+static void PACING_StartWindow(Bit64u now) {
+	pacing.window_start=now;
+	pacing.slept=0;
+	pacing.scheduled=0;
+	ticksScheduled=0;
+	CPU_IODelayRemoved=0;
+}
+
+static void PACING_Reset(void) {
+	pacing.last=PACING_Now();
+	pacing.error[0]=pacing.error[1]=0;
+	pacing.smooth=0;
+	PACING_StartWindow(pacing.last);
+}
+
+static void PACING_AdjustCycles(Bit64u now) {
+	double busy=(double)(now-pacing.window_start-pacing.slept);
+	if (busy<1000) busy=1000;
+	/* Share of the host time the emulation may take, as with the classic code */
+	double ratio=ticksScheduled*1000.0*(CPU_CyclePercUsed*0.9/100.0)/busy;
+	Bit64s cproc=(Bit64s)CPU_CycleMax*(Bit64s)ticksScheduled;
+	if (cproc>0) {
+		/* Cycles skipped by the IO delay code cost no host time */
+		double removed=(double)CPU_IODelayRemoved/(double)cproc;
+		if (removed<0.95) ratio*=1.0-removed;
+		else ratio*=0.05;
+	}
+	/* Dropouts from a temporary load elsewhere on the host */
+	if (ratio<0.01) return;
+
+	/* Incremental PID on the log of the cycles, smoothed against jitter */
+	double error=log(ratio);
+	pacing.smooth=pacing.smooth*0.5+error*0.5;
+	double step=0.2*(pacing.smooth-pacing.error[0])+0.35*pacing.smooth+
+		0.05*(pacing.smooth-2*pacing.error[0]+pacing.error[1]);
+	pacing.error[1]=pacing.error[0];
+	pacing.error[0]=pacing.smooth;
+	if (step>0.7) step=0.7;
+	else if (step<-0.7) step=-0.7;
+
+	double new_cmax=CPU_CycleMax*exp(step);
+	if (new_cmax<CPU_CYCLES_LOWER_LIMIT) new_cmax=CPU_CYCLES_LOWER_LIMIT;
+	if (CPU_CycleLimit>0) {
+		if (new_cmax>CPU_CycleLimit) new_cmax=CPU_CycleLimit;
+	} else if (new_cmax>2000000) new_cmax=2000000;
+	CPU_CycleMax=(Bit32s)new_cmax;
+}
+
+static void PACING_IncreaseTicks(void) {
+	Bit64u now=PACING_Now();
+	if (GCC_UNLIKELY(ticksLocked)) { // For Fast Forward Mode
+		ticksRemain=5;
+		PACING_Reset();
+		return;
+	}
+	Bit64u elapsed=now-pacing.last;
+	if (elapsed<1000) {
+		/* Sleep right up to the next emulated millisecond */
+		PACING_Sleep(1000-elapsed);
+		pacing.slept+=PACING_Now()-now;
+		return;
+	}
+
+	/* The cycles were changed by hand, start measuring again */
+	if (ticksScheduled<pacing.scheduled) PACING_StartWindow(now);
+	if (CPU_CycleAutoAdjust && !CPU_SkipCycleAutoAdjust) {
+		if (now-pacing.window_start>=PACING_WINDOW && ticksScheduled>=5) {
+			PACING_AdjustCycles(now);
+			PACING_StartWindow(now);
+		}
+	} else PACING_StartWindow(now);
+
+	ticksRemain=(Bit32u)(elapsed/1000);
+	if (ticksRemain>PACING_BACKLOG) {
+		/* Too far behind, drop the backlog instead of rushing to catch up */
+		ticksRemain=PACING_BACKLOG;
+		pacing.last=now-elapsed%1000;
+	} else pacing.last+=(Bit64u)ticksRemain*1000;
+	ticksScheduled+=ticksRemain;
+	pacing.scheduled=ticksScheduled;
+}
+
 void increaseticks() { //Make it return ticksRemain and set it in the function above to remove the global variable.
+	if (pacing.precise) {
+		PACING_IncreaseTicks();
+		return;
+	}
 	if (GCC_UNLIKELY(ticksLocked)) { // For Fast Forward Mode
 		ticksRemain=5;
 		/* Reset any auto cycle guessing for this frame */
@@ -360,6 +508,8 @@ static void DOSBOX_RealInit(Section * sec) {
 	ticksRemain=0;
 	ticksLast=GetTicks();
 	ticksLocked = false;
+	pacing.precise = (strcmp(section->Get_string("pacing"),"precise")==0);
+	PACING_Reset();
 	DOSBOX_SetLoop(&Normal_Loop);
 	MSG_Init(section);
 
@@ -466,6 +616,16 @@ void DOSBOX_Init(void) {
 	Pstring = secprop->Add_path("captures",Property::Changeable::Always,"capture");
 	Pstring->Set_help("Directory where things like wave, midi, screenshot get captured.");
 
+	Pint = secprop->Add_int("capturethreads",Property::Changeable::OnlyAtStart,2);
+	Pint->SetMinMax(0,16);
+	Pint->Set_help("Number of threads used to encode captured video (0=encode on the emulation thread).");
+
+	const char* pacings[] = { "classic", "precise", 0 };
+	Pstring = secprop->Add_string("pacing",Property::Changeable::OnlyAtStart,"classic");
+	Pstring->Set_values(pacings);
+	Pstring->Set_help("How emulation is paced against the host clock. precise uses a microsecond clock\n"
+		"and a smoothed controller for auto cycles instead of the 1 ms sleep heuristics.");
+
 	//for loading a fontx2 Japanese font
 	Pstring = secprop->Add_path("jfontsbcs",Property::Changeable::OnlyAtStart,"");
 	Pstring->Set_help("FONTX2 file used to rendering SBCS characters (8x19).");
@@ -477,6 +637,11 @@ void DOSBOX_Init(void) {
 	Pstring->Set_help("FONTX2 file used to rendering SBCS characters (24x24).");
 	Pstring = secprop->Add_path("jfontsbcs24",Property::Changeable::OnlyAtStart,"");
 	Pstring->Set_help("FONTX2 file used to rendering SBCS characters (12x24).");
+	Pstring = secprop->Add_path("jfontcache",Property::Changeable::OnlyAtStart,"");
+	Pstring->Set_help("File used to keep rasterized DBCS characters between sessions.");
+	Pint = secprop->Add_int("jfontprerender",Property::Changeable::OnlyAtStart,0);
+	Pint->SetMinMax(0,64);
+	Pint->Set_help("Number of threads used to rasterize all DBCS characters at startup (0=on demand).");
 #if defined(LINUX)
 	Pstring = secprop->Add_string("jfontname",Property::Changeable::OnlyAtStart,"");
 	Pstring->Set_help("not used.");
@@ -519,6 +684,9 @@ void DOSBOX_Init(void) {
 	Pstring->Set_values(fepcontrol_settings);
 	Pstring->Set_help("FEP control API");
 
+	Pbool = secprop->Add_bool("vtextdeferred",Property::Changeable::OnlyAtStart,false);
+	Pbool->Set_help("Repaint changed DOS/V text cells once per frame instead of on every write.");
+
 	Pbool = secprop->Add_bool("debug",Property::Changeable::OnlyAtStart,false);
 	Pbool->Set_help("debug flag");
 
@@ -537,11 +705,18 @@ void DOSBOX_Init(void) {
 		"  This value is best left at its default to avoid problems with some games,\n"
 		"  though few games might require a higher value.\n"
 		"  There is generally no speed advantage when raising this value.");
+
+	Pstring = secprop->Add_path("savestate",Property::Changeable::OnlyAtStart,"");
+	Pstring->Set_help(
+		"Save state file. The save and load state keys write and restore the whole\n"
+		"  machine, when it exists it is restored as soon as the shell is ready.\n"
+		"  A state can only be loaded by the same build with the same memsize.");
 	secprop->AddInitFunction(&CALLBACK_Init);
 	secprop->AddInitFunction(&PIC_Init);//done
 	secprop->AddInitFunction(&PROGRAMS_Init);
 	secprop->AddInitFunction(&TIMER_Init);//done
 	secprop->AddInitFunction(&CMOS_Init);//done
+	secprop->AddInitFunction(&SAVESTATE_Init);
 
 	secprop=control->AddSection_prop("render",&RENDER_Init,true);
 	Pint = secprop->Add_int("frameskip",Property::Changeable::Always,0);
@@ -615,6 +790,22 @@ void DOSBOX_Init(void) {
 	Pint = secprop->Add_int("cycledown",Property::Changeable::Always,20);
 	Pint->SetMinMax(1,1000000);
 	Pint->Set_help("Setting it lower than 100 will be a percentage.");
+
+	Pint = secprop->Add_int("dyncache",Property::Changeable::OnlyAtStart,8);
+	Pint->SetMinMax(2,256);
+	Pint->Set_help("Size of the dynamic core's code cache in megabytes.");
+
+	Pint = secprop->Add_int("dyncachemax",Property::Changeable::OnlyAtStart,64);
+	Pint->SetMinMax(2,1024);
+	Pint->Set_help("The code cache grows by dyncache megabytes when it is full, up to this size.");
+
+	Pint = secprop->Add_int("dynwarmup",Property::Changeable::OnlyAtStart,0);
+	Pint->SetMinMax(0,255);
+	Pint->Set_help("How often code runs in the normal core before the dynamic core translates it.\n"
+		"Avoids translating code that only runs once. 0 translates right away.");
+
+	Pbool = secprop->Add_bool("dynsuperblocks",Property::Changeable::OnlyAtStart,false);
+	Pbool->Set_help("Translate hot code of the dynamic core again, continuing through short forward jumps.");
 		
 #if C_FPU
 	secprop->AddInitFunction(&FPU_Init);
@@ -889,6 +1080,24 @@ void DOSBOX_Init(void) {
 	Pbool = secprop->Add_bool("hosttime",Property::Changeable::OnlyAtStart, false);
 	Pbool->Set_help("Use host OS time in DOS functions(0x2a/0x2c).");
 
+	Pbool = secprop->Add_bool("filemap",Property::Changeable::OnlyAtStart, true);
+	Pbool->Set_help("Map larger files on local drives that are opened for reading into\n"
+		"memory. Not available on Windows.");
+
+	Pbool = secprop->Add_bool("hostwatch",Property::Changeable::OnlyAtStart, false);
+	Pbool->Set_help("Show files that host programs add, remove or rename in mounted local\n"
+		"directories without a rescan. Linux only.");
+
+	Pint = secprop->Add_int("imagecache",Property::Changeable::OnlyAtStart,1024);
+	Pint->SetMinMax(0,65536);
+	Pint->Set_help("Size in KB of the sector cache of each mounted disk image (0 disables).\n"
+		"Written sectors are held back for imageflush ms.");
+
+	Pint = secprop->Add_int("imageflush",Property::Changeable::OnlyAtStart,0);
+	Pint->SetMinMax(0,60000);
+	Pint->Set_help("Milliseconds written sectors can stay in the cache of a disk image.\n"
+		"0 writes them through at once.");
+
 	// Mscdex
 	secprop->AddInitFunction(&MSCDEX_Init);
 	secprop->AddInitFunction(&DRIVES_Init);
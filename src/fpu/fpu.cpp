@@ -26,6 +26,7 @@
 #include "mem.h"
 #include "fpu.h"
 #include "cpu.h"
+#include "savestate.h"
 
 FPU_rec fpu;
 
@@ -623,8 +624,13 @@ void FPU_ESC7_Normal(Bitu rm) {
 }
 
 
+static void FPU_SaveState(SaveStream & stream) {
+	stream.Pod(fpu);
+}
+
 void FPU_Init(Section*) {
 	FPU_FINIT();
+	SAVESTATE_Register("fpu",&FPU_SaveState);
 }
 
 #endif
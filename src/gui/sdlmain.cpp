@@ -2429,6 +2429,8 @@ int main(int argc, char* argv[]) {
 	LOG_MSG("Long File Name (LFN), mouse copy/paste and other support, by Wengier,2014-2017.");
 	LOG_MSG("---");
 
+	JFONT_InitThreads();
+
 	/* Init SDL */
 #if SDL_VERSION_ATLEAST(1, 2, 14)
 	/* Or debian/ubuntu with older libsdl version as they have done this themselves, but then differently.
@@ -27,6 +27,7 @@
 #include "mem.h"
 #include "bios_disk.h"
 #include "setup.h"
+#include "savestate.h"
 #include "cross.h" //fmod on certain platforms
 
 static struct {
@@ -288,6 +289,10 @@ void CMOS_SetRegister(Bitu regNr, Bit8u val) {
 }
 
 
+static void CMOS_SaveState(SaveStream & stream) {
+	stream.Bytes(&cmos,sizeof(cmos));
+}
+
 class CMOS:public Module_base{
 private:
 	IO_ReadHandleObject ReadHandler[2];
@@ -315,6 +320,7 @@ public:
 		cmos.regs[0x18]=(Bit8u)(exsize >> 8);
 		cmos.regs[0x30]=(Bit8u)exsize;
 		cmos.regs[0x31]=(Bit8u)(exsize >> 8);
+		SAVESTATE_Register("cmos",&CMOS_SaveState);
 	}
 };
 
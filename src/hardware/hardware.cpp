@@ -34,6 +34,7 @@
 
 #if (C_SSHOT)
 #include <png.h>
+#include "SDL_thread.h"
 #include "../libs/zmbv/zmbv.cpp"
 #endif
 
@@ -44,6 +45,8 @@ Bitu CaptureState;
 #define WAVE_BUF 16*1024
 #define MIDI_BUF 4*1024
 #define AVI_HEADER_SIZE	500
+#define VIDEO_SLOTS	4
+#define VIDEO_MAX_THREADS	16
 
 static struct {
 	struct {
@@ -78,10 +81,47 @@ static struct {
 		void		*buf;
 		Bit8u		*index;
 		Bitu		indexsize, indexused;
+		Bitu		queued;
 	} video;
 #endif
 } capture;
 
+#if (C_SSHOT)
+/* A captured frame on its way through the encoder threads */
+struct CaptureFrame {
+	Bit8u		*pixels;
+	char		pal[256*4];
+	bool		has_pal;
+	int			codecFlags;
+	bool		encoded;
+	void		*buf;
+	VideoCodec::FrameData data;
+	Bit16s		audiobuf[WAVE_BUF][2];
+	Bitu		audioused;
+};
+
+/* Frames go from the emulation thread to the encoder thread, which splits the
+   motion search over the search threads by block rows, and then on to the
+   deflate thread, which also writes the avi chunks. */
+static struct {
+	Bitu		threads;
+	bool		running;
+	volatile bool	quit;
+	volatile bool	failed;
+	zmbv_format_t	format;
+	Bitu		rowsize;
+	CaptureFrame	*slots;
+	Bitu		submit;
+	SDL_Thread	*encode_thread, *deflate_thread;
+	SDL_Thread	*search_threads[VIDEO_MAX_THREADS];
+	Bitu		search_count;
+	SDL_sem		*free_slots, *encode_ready, *deflate_ready, *work_free;
+	SDL_sem		*search_start, *search_done;
+	SDL_mutex	*search_lock;
+	int			search_next;
+} encoder;
+#endif
+
 FILE * OpenCaptureFile(const char * type,const char * ext) {
 	if(capturedir.empty()) {
 		LOG_MSG("Please specify a capture directory");
@@ -159,6 +199,153 @@ static void CAPTURE_AddAviChunk(const char * tag, Bit32u size, void * data, Bit3
 	host_writed(index+8, pos);
 	host_writed(index+12, size);
 }
+
+/* Hand out single block rows until the frame is searched */
+static void CAPTURE_SearchRows(void) {
+	int rows = capture.video.codec->BlockRows();
+	for (;;) {
+		SDL_mutexP(encoder.search_lock);
+		int row = encoder.search_next++;
+		SDL_mutexV(encoder.search_lock);
+		if (row >= rows) break;
+		capture.video.codec->SearchBlockRows(row, 1);
+	}
+}
+
+static int CAPTURE_SearchThread(void * /*data*/) {
+	for (;;) {
+		SDL_SemWait(encoder.search_start);
+		if (encoder.quit) break;
+		CAPTURE_SearchRows();
+		SDL_SemPost(encoder.search_done);
+	}
+	return 0;
+}
+
+static int CAPTURE_EncodeThread(void * /*data*/) {
+	Bitu pos = 0;
+	for (;;) {
+		SDL_SemWait(encoder.encode_ready);
+		if (encoder.quit) break;
+		CaptureFrame * frame = &encoder.slots[pos];
+		pos = (pos + 1) % VIDEO_SLOTS;
+		/* The work buffer is shared with the frame deflated two frames ago */
+		SDL_SemWait(encoder.work_free);
+		frame->encoded = !encoder.failed && capture.video.codec->PrepareCompressFrame(frame->codecFlags,
+			encoder.format, frame->has_pal ? frame->pal : 0, frame->buf, capture.video.bufSize);
+		if (frame->encoded) {
+			for (Bitu i=0;i<capture.video.height;i++) {
+				void * rowPointer = frame->pixels + i * encoder.rowsize;
+				capture.video.codec->CompressLines( 1, &rowPointer );
+			}
+			encoder.search_next = 0;
+			for (Bitu i=0;i<encoder.search_count;i++) SDL_SemPost(encoder.search_start);
+			CAPTURE_SearchRows();
+			for (Bitu i=0;i<encoder.search_count;i++) SDL_SemWait(encoder.search_done);
+			frame->data = capture.video.codec->EncodeFrame();
+		} else {
+			encoder.failed = true;
+		}
+		SDL_SemPost(encoder.deflate_ready);
+	}
+	return 0;
+}
+
+static int CAPTURE_DeflateThread(void * /*data*/) {
+	Bitu pos = 0;
+	for (;;) {
+		SDL_SemWait(encoder.deflate_ready);
+		if (encoder.quit) break;
+		CaptureFrame * frame = &encoder.slots[pos];
+		pos = (pos + 1) % VIDEO_SLOTS;
+		if (frame->encoded) {
+			int written = capture.video.codec->DeflateFrame(frame->data);
+			CAPTURE_AddAviChunk( "00dc", written, frame->buf, frame->codecFlags & 1 ? 0x10 : 0x0);
+			capture.video.frames++;
+			if ( frame->audioused ) {
+				CAPTURE_AddAviChunk( "01wb", frame->audioused * 4, frame->audiobuf, 0);
+				capture.video.audiowritten = frame->audioused*4;
+			}
+		}
+		SDL_SemPost(encoder.work_free);
+		SDL_SemPost(encoder.free_slots);
+	}
+	return 0;
+}
+
+static void CAPTURE_StopEncoder(void) {
+	if (!encoder.running)
+		return;
+	/* Wait until every queued frame is written */
+	for (Bitu i=0;i<VIDEO_SLOTS;i++) SDL_SemWait(encoder.free_slots);
+	encoder.quit = true;
+	SDL_SemPost(encoder.encode_ready);
+	SDL_SemPost(encoder.deflate_ready);
+	for (Bitu i=0;i<encoder.search_count;i++) SDL_SemPost(encoder.search_start);
+	if (encoder.encode_thread) SDL_WaitThread(encoder.encode_thread, 0);
+	if (encoder.deflate_thread) SDL_WaitThread(encoder.deflate_thread, 0);
+	for (Bitu i=0;i<encoder.search_count;i++) SDL_WaitThread(encoder.search_threads[i], 0);
+	SDL_DestroySemaphore(encoder.free_slots);
+	SDL_DestroySemaphore(encoder.encode_ready);
+	SDL_DestroySemaphore(encoder.deflate_ready);
+	SDL_DestroySemaphore(encoder.work_free);
+	SDL_DestroySemaphore(encoder.search_start);
+	SDL_DestroySemaphore(encoder.search_done);
+	SDL_DestroyMutex(encoder.search_lock);
+	for (Bitu i=0;i<VIDEO_SLOTS;i++) {
+		free(encoder.slots[i].pixels);
+		free(encoder.slots[i].buf);
+	}
+	delete[] encoder.slots;
+	encoder.slots = 0;
+	encoder.running = false;
+}
+
+static bool CAPTURE_StartEncoder(Bitu width, Bitu height, zmbv_format_t format) {
+	encoder.format = format;
+	encoder.rowsize = width * (format == ZMBV_FORMAT_8BPP ? 1 : (format == ZMBV_FORMAT_32BPP ? 4 : 2));
+	encoder.slots = new CaptureFrame[VIDEO_SLOTS];
+	for (Bitu i=0;i<VIDEO_SLOTS;i++) {
+		encoder.slots[i].pixels = (Bit8u *)malloc(encoder.rowsize * height);
+		encoder.slots[i].buf = malloc(capture.video.bufSize);
+		if (!encoder.slots[i].pixels || !encoder.slots[i].buf) {
+			for (Bitu j=0;j<=i;j++) {
+				free(encoder.slots[j].pixels);
+				free(encoder.slots[j].buf);
+			}
+			delete[] encoder.slots;
+			encoder.slots = 0;
+			return false;
+		}
+	}
+	encoder.quit = false;
+	encoder.failed = false;
+	encoder.submit = 0;
+	encoder.free_slots = SDL_CreateSemaphore(VIDEO_SLOTS);
+	encoder.encode_ready = SDL_CreateSemaphore(0);
+	encoder.deflate_ready = SDL_CreateSemaphore(0);
+	encoder.work_free = SDL_CreateSemaphore(2);
+	encoder.search_start = SDL_CreateSemaphore(0);
+	encoder.search_done = SDL_CreateSemaphore(0);
+	encoder.search_lock = SDL_CreateMutex();
+	encoder.search_count = 0;
+	encoder.encode_thread = encoder.deflate_thread = 0;
+	encoder.running = true;
+	/* Threads that did start are stopped again if one of them doesn't */
+	bool started = true;
+	while (started && encoder.search_count < encoder.threads - 1) {
+		encoder.search_threads[encoder.search_count] = SDL_CreateThread(CAPTURE_SearchThread, 0);
+		if (encoder.search_threads[encoder.search_count]) encoder.search_count++;
+		else started = false;
+	}
+	if (started) started = (encoder.encode_thread = SDL_CreateThread(CAPTURE_EncodeThread, 0)) != 0;
+	if (started) started = (encoder.deflate_thread = SDL_CreateThread(CAPTURE_DeflateThread, 0)) != 0;
+	if (!started) {
+		CAPTURE_StopEncoder();
+		return false;
+	}
+	return true;
+}
 #endif
 
 #if (C_SSHOT)
@@ -168,6 +355,7 @@ static void CAPTURE_VideoEvent(bool pressed) {
 	if (CaptureState & CAPTURE_VIDEO) {
 		/* Close the video */
 		CaptureState &= ~CAPTURE_VIDEO;
+		CAPTURE_StopEncoder();
 		LOG_MSG("Stopped capturing video.");	
 
 		Bit8u avi_header[AVI_HEADER_SIZE];
@@ -504,15 +692,32 @@ skip_shot:
 			for (i=0;i<AVI_HEADER_SIZE;i++)
 				fputc(0,capture.video.handle);
 			capture.video.frames = 0;
+			capture.video.queued = 0;
 			capture.video.written = 0;
 			capture.video.audioused = 0;
 			capture.video.audiowritten = 0;
+			if (encoder.threads && !CAPTURE_StartEncoder(width, height, format)) {
+				LOG_MSG("Capture threads could not be started, encoding on the emulation thread");
+				encoder.threads = 0;
+			}
 		}
 		int codecFlags;
-		if (capture.video.frames % 300 == 0)
+		if (capture.video.queued % 300 == 0)
 			codecFlags = 1;
 		else codecFlags = 0;
-		if (!capture.video.codec->PrepareCompressFrame( codecFlags, format, (char *)pal, capture.video.buf, capture.video.bufSize))
+		CaptureFrame * frame = 0;
+		if (encoder.running) {
+			if (encoder.failed) {
+				/* Stop the threads and finish the file with the frames written so far */
+				CaptureState |= CAPTURE_VIDEO;
+				CAPTURE_VideoEvent(true);
+				goto skip_video;
+			}
+			/* Blocks while all slots are still being encoded */
+			SDL_SemWait(encoder.free_slots);
+			frame = &encoder.slots[encoder.submit];
+			encoder.submit = (encoder.submit + 1) % VIDEO_SLOTS;
+		} else if (!capture.video.codec->PrepareCompressFrame( codecFlags, format, (char *)pal, capture.video.buf, capture.video.bufSize))
 			goto skip_video;
 
 		for (i=0;i<height;i++) {
@@ -550,18 +755,33 @@ skip_shot:
 				else
 					rowPointer=(data+(i >> 0)*pitch);
 			}
-			capture.video.codec->CompressLines( 1, &rowPointer );
+			if (frame)
+				memcpy(frame->pixels + i * encoder.rowsize, rowPointer, encoder.rowsize);
+			else
+				capture.video.codec->CompressLines( 1, &rowPointer );
 		}
-		int written = capture.video.codec->FinishCompressFrame();
-		if (written < 0)
-			goto skip_video;
-		CAPTURE_AddAviChunk( "00dc", written, capture.video.buf, codecFlags & 1 ? 0x10 : 0x0);
-		capture.video.frames++;
-//		LOG_MSG("Frame %d video %d audio %d",capture.video.frames, written, capture.video.audioused *4 );
-		if ( capture.video.audioused ) {
-			CAPTURE_AddAviChunk( "01wb", capture.video.audioused * 4, capture.video.audiobuf, 0);
-			capture.video.audiowritten = capture.video.audioused*4;
+		capture.video.queued++;
+		if (frame) {
+			frame->codecFlags = codecFlags;
+			frame->has_pal = pal != 0;
+			if (pal)
+				memcpy(frame->pal, pal, sizeof(frame->pal));
+			frame->audioused = capture.video.audioused;
+			memcpy(frame->audiobuf, capture.video.audiobuf, capture.video.audioused * 4);
 			capture.video.audioused = 0;
+			SDL_SemPost(encoder.encode_ready);
+		} else {
+			int written = capture.video.codec->FinishCompressFrame();
+			if (written < 0)
+				goto skip_video;
+			CAPTURE_AddAviChunk( "00dc", written, capture.video.buf, codecFlags & 1 ? 0x10 : 0x0);
+			capture.video.frames++;
+//			LOG_MSG("Frame %d video %d audio %d",capture.video.frames, written, capture.video.audioused *4 );
+			if ( capture.video.audioused ) {
+				CAPTURE_AddAviChunk( "01wb", capture.video.audioused * 4, capture.video.audiobuf, 0);
+				capture.video.audiowritten = capture.video.audioused*4;
+				capture.video.audioused = 0;
+			}
 		}
 
 		/* Everything went okay, set flag again for next frame */
@@ -752,6 +972,9 @@ public:
 		Prop_path* proppath= section->Get_path("captures");
 		capturedir = proppath->realpath;
 		CaptureState = 0;
+#if (C_SSHOT)
+		encoder.threads = section->Get_int("capturethreads");
+#endif
 		MAPPER_AddHandler(CAPTURE_WaveEvent,MK_f6,MMOD1,"recwave","Rec Wave");
 		MAPPER_AddHandler(CAPTURE_MidiEvent,MK_f8,MMOD1|MMOD2,"caprawmidi","Cap MIDI");
 #if (C_SSHOT)
@@ -26,6 +26,7 @@
 #include "mixer.h"
 #include "timer.h"
 #include "jega.h"
+#include "savestate.h"
 
 #define KEYBUFSIZE 32
 #define KEYDELAY 0.300f			//Considering 20-30 khz serial clock and 11 bits/char
@@ -433,6 +434,12 @@ static void KEYBOARD_TickHandler(void) {
 	}
 }
 
+static void KEYBOARD_SaveState(SaveStream & stream) {
+	stream.Bytes(&keyb,sizeof(keyb));
+	stream.Pod(port_61_data);
+	if (stream.loading) PCSPEAKER_SetType(port_61_data & 3);
+}
+
 void KEYBOARD_Init(Section* sec) {
 	IO_RegisterWriteHandler(0x60,write_p60,IO_MB);
 	IO_RegisterReadHandler(0x60,read_p60,IO_MB);
@@ -452,4 +459,5 @@ void KEYBOARD_Init(Section* sec) {
 	keyb.repeat.rate=33;
 	keyb.repeat.wait=0;
 	KEYBOARD_ClrBuffer();
+	SAVESTATE_Register("keyboard",&KEYBOARD_SaveState);
 }
@@ -23,9 +23,17 @@
 #include "setup.h"
 #include "paging.h"
 #include "regs.h"
+#include "savestate.h"
 
 #include <string.h>
 
+#if (C_HAVE_MPROTECT)
+#include <sys/mman.h>
+#if !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
 #define PAGES_IN_BLOCK	((1024*1024)/MEM_PAGE_SIZE)
 #define SAFE_MEMORY	32
 #define MAX_MEMORY	64
@@ -57,6 +65,7 @@ static struct MemoryBlock {
 } memory;
 
 HostPt MemBase;
+static Bitu membase_size;
 
 class IllegalPageHandler : public PageHandler {
 public:
@@ -191,6 +200,24 @@ void MEM_BlockWrite(PhysPt pt,void const * const data,Bitu size) {
 	}
 }
 
+HostPt MEM_GetBlockHostPt(PhysPt pt,Bitu size,bool write) {
+	HostPt start=0;
+	for (Bitu done=0;done<size;done+=MEM_PAGESIZE-((pt+done)&(MEM_PAGESIZE-1))) {
+		PhysPt addr=pt+done;
+		/* Without paging the page can be linked without side effects */
+		if (!PAGING_Enabled()) PAGING_ForcePageInit(addr);
+		/* Pages with handlers, like code pages of the dynamic core, have no direct pointer */
+		HostPt tlb=write ? get_tlb_write(addr) : get_tlb_read(addr);
+		if (!tlb) return 0;
+		HostPt host=tlb+addr;
+		if (host<MemBase || host>=MemBase+memory.pages*MEM_PAGESIZE) return 0;
+		if (!done) start=host;
+		else if (host!=start+done) return 0;
+	}
+	if (start+size>MemBase+memory.pages*MEM_PAGESIZE) return 0;
+	return start;
+}
+
 void MEM_BlockCopy(PhysPt dest,PhysPt src,Bitu size) {
 	mem_memcpy(dest,src,size);
 }
@@ -543,6 +570,22 @@ void PreparePCJRCartRom(void) {
 
 HostPt GetMemBase(void) { return MemBase; }
 
+bool MEM_WriteImage(FILE * f) {
+	return fwrite(MemBase,1,membase_size,f)==membase_size;
+}
+
+/* Replace guest memory with an image, pages stay shared with the file
+ * until the guest writes to them. MemBase keeps its address. */
+bool MEM_MapImage(FILE * f,Bit32u offset) {
+	if (fseek(f,0,SEEK_END) || (Bitu)ftell(f)<offset+membase_size) return false;
+#if (C_HAVE_MPROTECT)
+	void * map=mmap(MemBase,membase_size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_FIXED,fileno(f),offset);
+	if (map!=MAP_FAILED) return true;
+#endif
+	if (fseek(f,offset,SEEK_SET)) return false;
+	return fread(MemBase,1,membase_size,f)==membase_size;
+}
+
 class MEMORY:public Module_base{
 private:
 	IO_ReadHandleObject ReadHandler;
@@ -565,11 +608,19 @@ public:
 			LOG_MSG("Memory sizes above %d MB are NOT recommended.",SAFE_MEMORY - 1);
 			LOG_MSG("Stick with the default values unless you are absolutely certain.");
 		}
-		MemBase = new Bit8u[memsize*1024*1024];
+		membase_size = memsize*1024*1024;
+#if (C_HAVE_MPROTECT)
+		/* Anonymous pages are zeroed and only use host memory once touched,
+		 * a loaded save state maps its image over them */
+		MemBase = (HostPt)mmap(NULL,membase_size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+		if (MemBase==(HostPt)MAP_FAILED) E_Exit("Can't allocate main memory of %d MB",memsize);
+#else
+		MemBase = new Bit8u[membase_size];
 		if (!MemBase) E_Exit("Can't allocate main memory of %d MB",memsize);
 		/* Clear the memory, as new doesn't always give zeroed memory
 		 * (Visual C debug mode). We want zeroed memory though. */
-		memset((void*)MemBase,0,memsize*1024*1024);
+		memset((void*)MemBase,0,membase_size);
+#endif
 		memory.pages = (memsize*1024*1024)/4096;
 		/* Allocate the data for the different page information blocks */
 		memory.phandlers=new  PageHandler * [memory.pages];
@@ -600,13 +651,24 @@ public:
 		MEM_A20_Enable(false);
 	}
 	~MEMORY(){
+#if (C_HAVE_MPROTECT)
+		munmap(MemBase,membase_size);
+#else
 		delete [] MemBase;
+#endif
 		delete [] memory.phandlers;
 		delete [] memory.mhandles;
 	}
 };	
 
 	
+static void MEM_SaveState(SaveStream & stream) {
+	/* RAM itself is written as the image behind the records */
+	stream.Pod(memory.a20);
+	stream.Bytes(memory.mhandles,memory.pages*sizeof(MemHandle));
+	if (stream.loading) MEM_A20_Enable(memory.a20.enabled);
+}
+
 static MEMORY* test;	
 	
 static void MEM_ShutDown(Section * sec) {
@@ -617,4 +679,5 @@ void MEM_Init(Section * sec) {
 	/* shutdown function */
 	test = new MEMORY(sec);
 	sec->AddDestroyFunction(&MEM_ShutDown);
+	SAVESTATE_Register("memory",&MEM_SaveState);
 }
@@ -48,6 +48,7 @@
 #include "hardware.h"
 #include "programs.h"
 #include "midi.h"
+#include "savestate.h"
 
 #define MIXER_SSIZE 4
 #define MIXER_SHIFT 14
@@ -605,6 +606,33 @@ MixerObject::~MixerObject(){
 }
 
 
+static void MIXER_SaveState(SaveStream & stream) {
+	/* Only the volumes, the devices restart their own output */
+	stream.Pod(mixer.mastervol);
+	Bit32u count=0;
+	for (MixerChannel * chan=mixer.channels;chan;chan=chan->next) count++;
+	stream.Pod(count);
+	MixerChannel * chan=mixer.channels;
+	for (Bit32u i=0;i<count && !stream.failed;i++) {
+		std::string name;
+		float volmain[2];
+		if (!stream.loading) {
+			name=chan->name;
+			volmain[0]=chan->volmain[0];
+			volmain[1]=chan->volmain[1];
+			chan=chan->next;
+		}
+		stream.String(name);
+		stream.Pod(volmain);
+		if (!stream.loading || stream.failed) continue;
+		MixerChannel * found=MIXER_FindChannel(name.c_str());
+		if (found) found->SetVolume(volmain[0],volmain[1]);
+	}
+	if (stream.loading) {
+		for (chan=mixer.channels;chan;chan=chan->next) chan->UpdateVolume();
+	}
+}
+
 void MIXER_Init(Section* sec) {
 	sec->AddDestroyFunction(&MIXER_Stop);
 
@@ -658,4 +686,5 @@ void MIXER_Init(Section* sec) {
 	mixer.max_needed=mixer.blocksize * 2 + 2*mixer.min_needed;
 	mixer.needed=mixer.min_needed+1;
 	PROGRAMS_MakeFile("MIXER.COM",MIXER_ProgramStart);
+	SAVESTATE_Register("mixer",&MIXER_SaveState);
 }
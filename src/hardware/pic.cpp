@@ -23,8 +23,10 @@
 #include "pic.h"
 #include "timer.h"
 #include "setup.h"
+#include "savestate.h"
 
 #define PIC_QUEUESIZE 512
+#define PIC_HASHSIZE 64
 
 struct PIC_Controller {
 	Bitu icw_words;
@@ -168,15 +170,33 @@ struct PICEntry {
 	float index;
 	Bitu value;
 	PIC_EventHandler pic_event;
-	PICEntry * next;
+	Bit32u order;				// keeps events with the same index in insertion order
+	Bitu heap_pos;
+	PICEntry * next;			// free list or handler chain
+	PICEntry * prev;
 };
 
+/* Pending events are kept in a binary min-heap ordered on index, a hash on
+ * the handler links the events of one handler for removal */
 static struct {
 	PICEntry entries[PIC_QUEUESIZE];
+	PICEntry * heap[PIC_QUEUESIZE];
+	PICEntry * handlers[PIC_HASHSIZE];
 	PICEntry * free_entry;
-	PICEntry * next_entry;
+	Bitu used;
+	Bit32u order;
 } pic_queue;
 
+static INLINE Bitu PIC_HandlerHash(PIC_EventHandler handler) {
+	Bitu key=(Bitu)handler;
+	return (key ^ (key >> 6) ^ (key >> 12)) & (PIC_HASHSIZE-1);
+}
+
+static INLINE bool PIC_EntryBefore(const PICEntry * a,const PICEntry * b) {
+	if (a->index!=b->index) return a->index<b->index;
+	return (Bit32s)(a->order-b->order)<0;
+}
+
 static void write_command(Bitu port,Bitu val,Bitu iolen) {
 	PIC_Controller * pic=&pics[port==0x20 ? 0 : 1];
 
@@ -369,31 +389,66 @@ void PIC_SetIRQMask(Bitu irq, bool masked) {
 	pic->set_imr(newmask);
 }
 
-static void AddEntry(PICEntry * entry) {
-	PICEntry * find_entry=pic_queue.next_entry;
-	if (GCC_UNLIKELY(find_entry ==0)) {
-		entry->next=0;
-		pic_queue.next_entry=entry;
-	} else if (find_entry->index>entry->index) {
-		pic_queue.next_entry=entry;
-		entry->next=find_entry;
-	} else while (find_entry) {
-		if (find_entry->next) {
-			/* See if the next index comes later than this one */
-			if (find_entry->next->index > entry->index) {
-				entry->next=find_entry->next;
-				find_entry->next=entry;
-				break;
-			} else {
-				find_entry=find_entry->next;
-			}
-		} else {
-			entry->next=find_entry->next;
-			find_entry->next=entry;
-			break;
-		}
+static void HeapPlace(PICEntry * entry,Bitu pos) {
+	pic_queue.heap[pos]=entry;
+	entry->heap_pos=pos;
+}
+
+static void HeapUp(Bitu pos) {
+	PICEntry * entry=pic_queue.heap[pos];
+	while (pos>0) {
+		Bitu parent=(pos-1)/2;
+		if (!PIC_EntryBefore(entry,pic_queue.heap[parent])) break;
+		HeapPlace(pic_queue.heap[parent],pos);
+		pos=parent;
+	}
+	HeapPlace(entry,pos);
+}
+
+static void HeapDown(Bitu pos) {
+	PICEntry * entry=pic_queue.heap[pos];
+	for (;;) {
+		Bitu child=pos*2+1;
+		if (child>=pic_queue.used) break;
+		if (child+1<pic_queue.used && PIC_EntryBefore(pic_queue.heap[child+1],pic_queue.heap[child])) child++;
+		if (!PIC_EntryBefore(pic_queue.heap[child],entry)) break;
+		HeapPlace(pic_queue.heap[child],pos);
+		pos=child;
+	}
+	HeapPlace(entry,pos);
+}
+
+static void LinkEntry(PICEntry * entry) {
+	PICEntry * * chain=&pic_queue.handlers[PIC_HandlerHash(entry->pic_event)];
+	entry->prev=0;
+	entry->next=*chain;
+	if (*chain) (*chain)->prev=entry;
+	*chain=entry;
+	HeapPlace(entry,pic_queue.used++);
+	HeapUp(entry->heap_pos);
+}
+
+/* Takes the entry out of the heap and its handler chain, release puts it on the free list */
+static void UnlinkEntry(PICEntry * entry,bool release) {
+	if (entry->prev) entry->prev->next=entry->next;
+	else pic_queue.handlers[PIC_HandlerHash(entry->pic_event)]=entry->next;
+	if (entry->next) entry->next->prev=entry->prev;
+	Bitu pos=entry->heap_pos;
+	PICEntry * last=pic_queue.heap[--pic_queue.used];
+	if (last!=entry) {
+		HeapPlace(last,pos);
+		if (pos>0 && PIC_EntryBefore(last,pic_queue.heap[(pos-1)/2])) HeapUp(pos);
+		else HeapDown(pos);
+	}
+	if (release) {
+		entry->next=pic_queue.free_entry;
+		pic_queue.free_entry=entry;
 	}
-	Bits cycles=PIC_MakeCycles(pic_queue.next_entry->index-PIC_TickIndex());
+}
+
+static void AddEntry(PICEntry * entry) {
+	LinkEntry(entry);
+	Bits cycles=PIC_MakeCycles(pic_queue.heap[0]->index-PIC_TickIndex());
 	if (cycles<CPU_Cycles) {
 		CPU_CycleLeft+=CPU_Cycles;
 		CPU_Cycles=0;
@@ -413,58 +468,27 @@ void PIC_AddEvent(PIC_EventHandler handler,float delay,Bitu val) {
 
 	entry->pic_event=handler;
 	entry->value=val;
+	entry->order=pic_queue.order++;
 	pic_queue.free_entry=pic_queue.free_entry->next;
 	AddEntry(entry);
 }
 
 void PIC_RemoveSpecificEvents(PIC_EventHandler handler, Bitu val) {
-	PICEntry * entry=pic_queue.next_entry;
-	PICEntry * prev_entry;
-	prev_entry = 0;
+	PICEntry * entry=pic_queue.handlers[PIC_HandlerHash(handler)];
 	while (entry) {
-		if (GCC_UNLIKELY((entry->pic_event == handler)) && (entry->value == val)) {
-			if (prev_entry) {
-				prev_entry->next=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=prev_entry->next;
-				continue;
-			} else {
-				pic_queue.next_entry=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=pic_queue.next_entry;
-				continue;
-			}
-		}
-		prev_entry=entry;
-		entry=entry->next;
-	}	
+		PICEntry * next_entry=entry->next;
+		if (GCC_UNLIKELY((entry->pic_event == handler)) && (entry->value == val)) UnlinkEntry(entry,true);
+		entry=next_entry;
+	}
 }
 
 void PIC_RemoveEvents(PIC_EventHandler handler) {
-	PICEntry * entry=pic_queue.next_entry;
-	PICEntry * prev_entry;
-	prev_entry=0;
+	PICEntry * entry=pic_queue.handlers[PIC_HandlerHash(handler)];
 	while (entry) {
-		if (GCC_UNLIKELY(entry->pic_event==handler)) {
-			if (prev_entry) {
-				prev_entry->next=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=prev_entry->next;
-				continue;
-			} else {
-				pic_queue.next_entry=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=pic_queue.next_entry;
-				continue;
-			}
-		}
-		prev_entry=entry;
-		entry=entry->next;
-	}	
+		PICEntry * next_entry=entry->next;
+		if (GCC_UNLIKELY(entry->pic_event==handler)) UnlinkEntry(entry,true);
+		entry=next_entry;
+	}
 }
 
 
@@ -478,9 +502,9 @@ bool PIC_RunQueue(void) {
 	/* Check the queue for an entry */
 	Bits index_nd=PIC_TickIndexND();
 	InEventService = true;
-	while (pic_queue.next_entry && (pic_queue.next_entry->index*CPU_CycleMax<=index_nd)) {
-		PICEntry * entry=pic_queue.next_entry;
-		pic_queue.next_entry=entry->next;
+	while (pic_queue.used && (pic_queue.heap[0]->index*CPU_CycleMax<=index_nd)) {
+		PICEntry * entry=pic_queue.heap[0];
+		UnlinkEntry(entry,false);
 
 		srv_lag = entry->index;
 		(entry->pic_event)(entry->value); // call the event handler
@@ -492,8 +516,8 @@ bool PIC_RunQueue(void) {
 	InEventService = false;
 
 	/* Check when to set the new cycle end */
-	if (pic_queue.next_entry) {
-		Bits cycles=(Bits)(pic_queue.next_entry->index*CPU_CycleMax-index_nd);
+	if (pic_queue.used) {
+		Bits cycles=(Bits)(pic_queue.heap[0]->index*CPU_CycleMax-index_nd);
 		if (GCC_UNLIKELY(!cycles)) cycles=1;
 		if (cycles<CPU_CycleLeft) {
 			CPU_Cycles=cycles;
@@ -542,11 +566,7 @@ void TIMER_AddTick(void) {
 	CPU_Cycles=0;
 	PIC_Ticks++;
 	/* Go through the list of scheduled events and lower their index with 1000 */
-	PICEntry * entry=pic_queue.next_entry;
-	while (entry) {
-		entry->index -= 1.0;
-		entry=entry->next;
-	}
+	for (Bitu i=0;i<pic_queue.used;i++) pic_queue.heap[i]->index -= 1.0;
 	/* Call our list of ticker handlers */
 	TickerBlock * ticker=firstticker;
 	while (ticker) {
@@ -556,6 +576,49 @@ void TIMER_AddTick(void) {
 	}
 }
 
+static void PIC_InitQueue(void) {
+	for (Bitu i=0;i<PIC_QUEUESIZE-1;i++) {
+		pic_queue.entries[i].next=&pic_queue.entries[i+1];
+	}
+	pic_queue.entries[PIC_QUEUESIZE-1].next=0;
+	pic_queue.free_entry=&pic_queue.entries[0];
+	for (Bitu i=0;i<PIC_HASHSIZE;i++) pic_queue.handlers[i]=0;
+	pic_queue.used=0;
+	pic_queue.order=0;
+}
+
+static void PIC_SaveState(SaveStream & stream) {
+	stream.Pod(pics);
+	stream.Pod(PIC_Ticks);
+	stream.Pod(PIC_IRQCheck);
+	Bit32u count=(Bit32u)pic_queue.used;
+	stream.Pod(count);
+	if (!stream.loading) {
+		/* Heap order, the insertion order of equal indices is saved along */
+		for (Bitu i=0;i<pic_queue.used;i++) {
+			PICEntry * entry=pic_queue.heap[i];
+			stream.Pod(entry->index);
+			stream.Pod(entry->value);
+			stream.Pod(entry->order);
+			stream.Code(entry->pic_event);
+		}
+		stream.Pod(pic_queue.order);
+		return;
+	}
+	PIC_InitQueue();
+	for (Bit32u i=0;i<count && i<PIC_QUEUESIZE;i++) {
+		PICEntry * entry=pic_queue.free_entry;
+		stream.Pod(entry->index);
+		stream.Pod(entry->value);
+		stream.Pod(entry->order);
+		stream.Code(entry->pic_event);
+		if (stream.failed) break;
+		pic_queue.free_entry=entry->next;
+		LinkEntry(entry);
+	}
+	stream.Pod(pic_queue.order);
+}
+
 /* Use full name to avoid name clash with compile option for position-independent code */
 class PIC_8259A: public Module_base {
 private:
@@ -600,12 +663,8 @@ public:
 		WriteHandler[2].Install(0xa0,write_command,IO_MB);
 		WriteHandler[3].Install(0xa1,write_data,IO_MB);
 		/* Initialize the pic queue */
-		for (i=0;i<PIC_QUEUESIZE-1;i++) {
-			pic_queue.entries[i].next=&pic_queue.entries[i+1];
-		}
-		pic_queue.entries[PIC_QUEUESIZE-1].next=0;
-		pic_queue.free_entry=&pic_queue.entries[0];
-		pic_queue.next_entry=0;
+		PIC_InitQueue();
+		SAVESTATE_Register("pic",&PIC_SaveState);
 	}
 
 	~PIC_8259A(){
@@ -25,6 +25,7 @@
 #include "mixer.h"
 #include "timer.h"
 #include "setup.h"
+#include "savestate.h"
 
 static INLINE void BIN2BCD(Bit16u& val) {
 	Bit16u temp=val%10 + (((val/10)%10)<<4)+ (((val/100)%10)<<8) + (((val/1000)%10)<<12);
@@ -402,6 +403,15 @@ void TIMER_SetGate2(bool in) {
 	gate2 = in; //Set it here so the counter_latch above works
 }
 
+static void TIMER_SaveState(SaveStream & stream) {
+	stream.Pod(pit);
+	stream.Pod(gate2);
+	stream.Pod(latched_timerstatus);
+	stream.Pod(latched_timerstatus_locked);
+	/* The counter 0 event itself comes back with the pic queue */
+	if (stream.loading) PCSPEAKER_SetCounter(pit[2].cntr,pit[2].mode);
+}
+
 class TIMER:public Module_base{
 private:
 	IO_ReadHandleObject ReadHandler[4];
@@ -453,6 +463,7 @@ public:
 		latched_timerstatus_locked=false;
 		gate2 = false;
 		PIC_AddEvent(PIT0_Event,pit[0].delay);
+		SAVESTATE_Register("timer",&TIMER_SaveState);
 	}
 	~TIMER(){
 		PIC_RemoveEvents(PIT0_Event);
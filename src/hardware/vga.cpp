@@ -24,6 +24,9 @@
 #include "video.h"
 #include "pic.h"
 #include "vga.h"
+#include "mem.h"
+#include "savestate.h"
+#include "dosv.h"
 
 #include <string.h>
 
@@ -180,6 +183,64 @@ void VGA_SetCGA4Table(Bit8u val0,Bit8u val1,Bit8u val2,Bit8u val3) {
 	}	
 }
 
+/* Tandy banks point either into guest memory or into video memory */
+static void VGA_SaveBase(SaveStream & stream,Bit8u * & base) {
+	Bit8u linear=(base>=vga.mem.linear && base<vga.mem.linear+vga.vmemsize);
+	Bit32u offset=(Bit32u)(base-(linear ? vga.mem.linear : MemBase));
+	stream.Pod(linear);
+	stream.Pod(offset);
+	if (stream.loading && !stream.failed) base=(linear ? vga.mem.linear : MemBase)+offset;
+}
+
+static void VGA_SaveState(SaveStream & stream) {
+	/* Deferred DOS/V text is painted before the planes are taken */
+	if (!stream.loading) DOSV_FlushText();
+	Bit32u vmemsize=vga.vmemsize;
+	stream.Pod(vmemsize);
+	if (vmemsize!=vga.vmemsize) {
+		stream.failed=true;
+		return;
+	}
+	VGAModes mode=vga.mode;
+	stream.Pod(mode);
+	stream.Pod(vga.misc_output);
+	stream.Pod(vga.config);
+	stream.Pod(vga.internal);
+	stream.Pod(vga.seq);
+	stream.Pod(vga.attr);
+	stream.Pod(vga.crtc);
+	stream.Pod(vga.gfx);
+	stream.Pod(vga.dac);
+	stream.Pod(vga.latch);
+	stream.Pod(vga.s3);
+	stream.Pod(vga.svga);
+	stream.Pod(vga.herc);
+	Bit8u * draw_base=vga.tandy.draw_base;
+	Bit8u * mem_base=vga.tandy.mem_base;
+	stream.Pod(vga.tandy);
+	vga.tandy.draw_base=draw_base;
+	vga.tandy.mem_base=mem_base;
+	VGA_SaveBase(stream,vga.tandy.draw_base);
+	VGA_SaveBase(stream,vga.tandy.mem_base);
+	stream.Pod(vga.other);
+	stream.Bytes(vga.draw.font,sizeof(vga.draw.font));
+	for (Bitu i=0;i<2;i++) {
+		Bit32u font_offset=(Bit32u)(vga.draw.font_tables[i]-vga.draw.font);
+		stream.Pod(font_offset);
+		if (stream.loading && font_offset<sizeof(vga.draw.font)) vga.draw.font_tables[i]=&vga.draw.font[font_offset];
+	}
+	stream.Bytes(vga.mem.linear,vga.vmemsize);
+	stream.Bytes(vga.fastmem,vga.vmemsize*2);
+	if (!stream.loading) return;
+	/* Start over with the drawing like a mode switch does */
+	VGA_KillDrawing();
+	vga.draw.resizing=false;
+	vga.mode=M_ERROR;
+	VGA_SetModeNow(mode);
+	VGA_DAC_UpdatePalette();
+	if (svgaCard==SVGA_S3Trio) VGA_StartUpdateLFB();
+}
+
 void VGA_Init(Section* sec) {
 //	Section_prop * section=static_cast<Section_prop *>(sec);
 	vga.draw.resizing=false;
@@ -196,6 +257,7 @@ void VGA_Init(Section* sec) {
 	JEGA_setupAX();
 	VGA_SetClock(0,CLK_25);
 	VGA_SetClock(1,CLK_28);
+	SAVESTATE_Register("vga",&VGA_SaveState);
 /* Generate tables */
 	VGA_SetCGA2Table(0,1);
 	VGA_SetCGA4Table(0,1,2,3);
@@ -195,6 +195,18 @@ void VGA_DAC_SetEntry(Bitu entry,Bit8u red,Bit8u green,Bit8u blue) {
 			VGA_DAC_SendColor( i, i );
 }
 
+void VGA_DAC_UpdatePalette(void) {
+	/* Resend the whole palette for the current mode */
+	switch (vga.mode) {
+	case M_VGA:
+	case M_LIN8:
+		for (Bitu i=0;i<256;i++) VGA_DAC_UpdateColor(i);
+		break;
+	default:
+		for (Bit8u i=0;i<16;i++) VGA_DAC_CombineColor(i,vga.dac.combine[i]);
+	}
+}
+
 void VGA_SetupDAC(void) {
 	vga.dac.first_changed=256;
 	vga.dac.bits=6;
@@ -29,6 +29,12 @@
 #include "vga.h"
 #include "pic.h"
 #include "jfont.h"
+#include "dosv.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VGA_SSE2
+#endif
 
 //#undef C_DEBUG
 //#define C_DEBUG 1
@@ -531,156 +537,212 @@ skip_cursor:
 	return TempLine;
 }
 
-// JEGA drawing line-----------------------------------------
-static Bit8u* VGA_TEXT_JEGA_Draw_Line(Bitu vidstart, Bitu line) {
-	// keep it aligned:
-	Bit16u* draw = ((Bit16u*)TempLine) + 16 - vga.draw.panning;
-	const Bit8u* vidmem = VGA_Text_Memwrap(vidstart); // pointer to chars+attribs
-	Bitu blocks = vga.draw.blocks;
-	if (vga.draw.panning) blocks++; // if the text is panned part of an 
-									// additional character becomes visible
-	Bitu background, foreground;
-	//temporary for DBCS
-	Bitu chr_left;
-	Bitu bsattr;
-	bool chr_wide = false;
-
-	while (blocks > 0) { // for each characters in a line
-		Bitu chr = *vidmem++;
-		Bitu attr = *vidmem++;
-		// SBCS or DBCS second block
-		if(chr_wide == false) {
-			// choose foreground color if blinking not set for this cell or blink on
-			if (!(jega.RMOD2 & 0x80))//bit7 First Attribute EGA/JEGA
-			{
-				background = attr >> 4; //in EGA
-				// if blinking is enabled bit7 is not mapped to attributes
-				foreground = (vga.draw.blink || (!(attr & 0x80))) ?
-					(attr & 0xf) : background;
-				// choose foreground color if blinking not set for this cell or blink on
-				if (vga.draw.blinking) background &= ~0x8;
-				bsattr = 0;
-			}
-			else {
-				foreground = (vga.draw.blink || (!(attr & 0x80))) ?
-					(attr & 0xf) : background;
-				//Background is always black(or transparent) in JEGA attribute mode
-				background = 0;
-				bsattr = attr;
-				if (bsattr & 0x40) {//Reversed in JEGA mode
-					Bitu tmp = background;
-					background = foreground;
-					foreground = tmp;
-				}
-			}
-			// Stay drawing If the char code is DBCS and not at last column.
-			if(isKanji1(chr) && blocks > 1) {
-				//Set the present char/attr code to the next loop
-				chr_left=chr;
-				chr_wide=true;
-			}
-			// the char code is ANK (8 dots width)
-			else 
-			{
-				// Get the font pattern
-				Bitu font = jfont_sbcs_19[chr*19+line];// w8xh19 font
-				// Draw 8 dots
-				for (Bitu n = 0; n < 8; n++) {
-					*draw++ = vga.dac.xlat16[(font & 0x80) ? foreground : background];
-					font <<= 1;
-				}
-				if (bsattr & 0x20) {
-					draw -= 8;
-					*draw = vga.dac.xlat16[foreground];//vertical line
-					draw += 8;
-				}
-				if (line == 18 && bsattr & 0x10) {
-					draw -= 8;
-					for (Bitu n = 0; n < 8; n++)
-						*draw++ = vga.dac.xlat16[foreground];//underline
-				}
-				chr_wide=false;
-				blocks--;// Move to the next column
-			}
-		}
-		// the char code may be in DBCS
-		else
-		{
-			Bitu pad_y = jega.RPSSC;//Set op padding of the line
-			Bitu exattr = 0;
-			//Note: The second column should be applied its basic attribute.
-			if (jega.RMOD2 & 0x40) {// if JEGA Extended Attribute is enabled
-				exattr = attr;
-				if ((exattr & 0x30) == 0x30) pad_y = jega.RPSSL;//Set top padding of lower 2x character
-				else if (exattr & 0x30) pad_y = jega.RPSSU;//Set top padding of upper 2x character
-			}
-			if (line >= pad_y && line < 16 + pad_y) {
-				// Check the char code is in Wide charset of Shift-JIS
-				if (isKanji2(chr)) {
-					Bitu fline = line - pad_y;//Start line of drawing 16x16 character
-					chr_left <<= 8;
-					// Fix vertical position
-					chr |= chr_left;
-					//Horizontal wide font (Extended Attribute)
-					if (exattr & 0x20) {
-						if (exattr & 0x10) fline = (fline >> 1) + 8;
-						else fline = fline >> 1;
-					}
-					// read font
-					GetDbcsFont(chr);
-					//Vertical wide font (Extended Attribute)
-					if (exattr & 0x40) {
-						// Get the font pattern
-						Bitu font = jfont_dbcs_16[chr * 32 + fline * 2];
-						if (!(exattr & 0x08))
-							font = jfont_dbcs_16[chr * 32 + fline * 2 + 1];
-						// Draw 8 dots
-						for (Bitu n = 0; n < 8; n++) {
-							*draw++ = vga.dac.xlat16[(font & 0x80) ? foreground : background];
-							*draw++ = vga.dac.xlat16[(font & 0x80) ? foreground : background];
-							font <<= 1;
-						}
-					}
-					else {
-						// Get the font pattern
-						Bitu font = jfont_dbcs_16[chr * 32 + fline * 2];
-						font <<= 8;
-						font |= jfont_dbcs_16[chr * 32 + fline * 2 + 1];
-						//Bold (Extended Attribute)
-						if (exattr &= 0x80)
-						{
-							Bitu font2 = font;
-							font2 >>= 1;
-							font |= font2;
-							//Original JEGA colours the last row with the next column's attribute.
-						}
-						// Draw 16 dots
-						for (Bitu n = 0; n < 16; n++) {
-							*draw++ = vga.dac.xlat16[(font & 0x8000) ? foreground : background];
-							font <<= 1;
-						}
-					}
-				}
-				// Ignore wide char code, put blank
-				else
-					for (Bitu n = 0; n < 16; n++)
-						*draw++ = vga.dac.xlat16[background];
-			}
-			else if (line == (17 + pad_y) && (bsattr & 0x10)) {
-					for (Bitu n = 0; n < 16; n++) 
-						*draw++ = vga.dac.xlat16[foreground];//underline
-			}
-			else for (Bitu n = 0; n < 16; n++) *draw++ = vga.dac.xlat16[background];//draw blank
-			if (bsattr & 0x20) {//vertical line draw at last
-				draw -= 16;
-				*draw = vga.dac.xlat16[foreground];
-				draw += 16;
-			}
-			chr_wide=false;
-			blocks-=2;// Move to +2 columns
-		}
-
-	}
+// JEGA drawing line-----------------------------------------
+#define JEGA_ROW_CELLS 256
+
+enum {
+	JEGA_CELL_SBCS,
+	JEGA_CELL_DBCS,			// lead byte followed by a valid second byte
+	JEGA_CELL_DBCS_BLANK	// lead byte followed by an invalid second byte
+};
+
+// 0xffff for every pixel whose font bit is set
+static Bit16u JEGA_Expand_Table[256][8];
+// each bit of a nibble doubled, for the horizontally wide font
+static Bit8u JEGA_Double_Table[16];
+
+// kanji pairing of the current text row, redone at the first scanline of each row
+static struct {
+	bool valid;
+	Bitu vidstart;
+	Bitu blocks;
+	Bit8u text[JEGA_ROW_CELLS * 2];
+	Bit8u kind[JEGA_ROW_CELLS];
+} jega_row;
+
+static void VGA_JEGA_InitTables(void) {
+	static bool inited = false;
+	if (inited) return;
+	for (Bitu i = 0; i < 256; i++) {
+		for (Bitu n = 0; n < 8; n++) {
+			JEGA_Expand_Table[i][n] = (i & (0x80 >> n)) ? 0xffff : 0;
+		}
+	}
+	for (Bitu i = 0; i < 16; i++) {
+		Bit8u bits = 0;
+		for (Bitu n = 0; n < 4; n++) {
+			if (i & (8 >> n)) bits |= 0xc0 >> (n * 2);
+		}
+		JEGA_Double_Table[i] = bits;
+	}
+	inited = true;
+}
+
+static INLINE void VGA_JEGA_Expand8(Bit16u * draw, Bitu font, Bit16u foreground, Bit16u background) {
+#if defined(VGA_SSE2)
+	const __m128i mask = _mm_loadu_si128((const __m128i *)JEGA_Expand_Table[font]);
+	const __m128i fg = _mm_set1_epi16((short)foreground);
+	const __m128i bg = _mm_set1_epi16((short)background);
+	_mm_storeu_si128((__m128i *)draw, _mm_or_si128(_mm_and_si128(mask, fg), _mm_andnot_si128(mask, bg)));
+#else
+	const Bit16u * mask = JEGA_Expand_Table[font];
+	for (Bitu n = 0; n < 8; n++) {
+		draw[n] = (foreground & mask[n]) | (background & ~mask[n]);
+	}
+#endif
+}
+
+static void VGA_JEGA_PairRow(const Bit8u * vidmem, Bitu vidstart, Bitu blocks) {
+	jega_row.valid = true;
+	jega_row.vidstart = vidstart;
+	jega_row.blocks = blocks;
+	memcpy(jega_row.text, vidmem, blocks * 2);
+	for (Bitu cell = 0; cell < blocks; ) {
+		Bitu chr = vidmem[cell * 2];
+		// the char code is DBCS and not at last column
+		if (isKanji1(chr) && blocks - cell > 1) {
+			Bitu chr2 = vidmem[cell * 2 + 2];
+			if (isKanji2(chr2)) {
+				// make sure the glyph is in jfont_dbcs_16
+				GetDbcsFont((chr << 8) | chr2);
+				jega_row.kind[cell] = JEGA_CELL_DBCS;
+			} else {
+				jega_row.kind[cell] = JEGA_CELL_DBCS_BLANK;
+			}
+			jega_row.kind[cell + 1] = JEGA_CELL_SBCS;
+			cell += 2;
+		} else {
+			jega_row.kind[cell++] = JEGA_CELL_SBCS;
+		}
+	}
+}
+
+static Bit8u* VGA_TEXT_JEGA_Draw_Line(Bitu vidstart, Bitu line) {
+	// keep it aligned:
+	Bit16u* draw = ((Bit16u*)TempLine) + 16 - vga.draw.panning;
+	const Bit8u* vidmem = VGA_Text_Memwrap(vidstart); // pointer to chars+attribs
+	Bitu blocks = vga.draw.blocks;
+	if (vga.draw.panning) blocks++; // if the text is panned part of an 
+									// additional character becomes visible
+	if (blocks > JEGA_ROW_CELLS) blocks = JEGA_ROW_CELLS;
+	if (line == 0 || !jega_row.valid || jega_row.vidstart != vidstart || jega_row.blocks != blocks ||
+		memcmp(jega_row.text, vidmem, blocks * 2)) {
+		VGA_JEGA_PairRow(vidmem, vidstart, blocks);
+	}
+	Bitu background, foreground;
+	Bitu bsattr;
+
+	for (Bitu cell = 0; cell < blocks; ) { // for each characters in a line
+		Bitu chr = vidmem[cell * 2];
+		Bitu attr = vidmem[cell * 2 + 1];
+		// choose foreground color if blinking not set for this cell or blink on
+		if (!(jega.RMOD2 & 0x80))//bit7 First Attribute EGA/JEGA
+		{
+			background = attr >> 4; //in EGA
+			// if blinking is enabled bit7 is not mapped to attributes
+			foreground = (vga.draw.blink || (!(attr & 0x80))) ?
+				(attr & 0xf) : background;
+			// choose foreground color if blinking not set for this cell or blink on
+			if (vga.draw.blinking) background &= ~0x8;
+			bsattr = 0;
+		}
+		else {
+			foreground = (vga.draw.blink || (!(attr & 0x80))) ?
+				(attr & 0xf) : background;
+			//Background is always black(or transparent) in JEGA attribute mode
+			background = 0;
+			bsattr = attr;
+			if (bsattr & 0x40) {//Reversed in JEGA mode
+				Bitu tmp = background;
+				background = foreground;
+				foreground = tmp;
+			}
+		}
+		Bit16u fg = vga.dac.xlat16[foreground];
+		Bit16u bg = vga.dac.xlat16[background];
+		// the char code is ANK (8 dots width)
+		if (jega_row.kind[cell] == JEGA_CELL_SBCS) {
+			// Draw 8 dots of the w8xh19 font
+			VGA_JEGA_Expand8(draw, jfont_sbcs_19[chr*19+line], fg, bg);
+			if (bsattr & 0x20) {
+				*draw = fg;//vertical line
+			}
+			if (line == 18 && bsattr & 0x10) {
+				VGA_JEGA_Expand8(draw, 0xff, fg, bg);//underline
+			}
+			draw += 8;
+			cell++;// Move to the next column
+			continue;
+		}
+		// the char code may be in DBCS
+		Bitu lead = chr;
+		chr = vidmem[cell * 2 + 2];
+		attr = vidmem[cell * 2 + 3];
+		Bitu pad_y = jega.RPSSC;//Set op padding of the line
+		Bitu exattr = 0;
+		//Note: The second column should be applied its basic attribute.
+		if (jega.RMOD2 & 0x40) {// if JEGA Extended Attribute is enabled
+			exattr = attr;
+			if ((exattr & 0x30) == 0x30) pad_y = jega.RPSSL;//Set top padding of lower 2x character
+			else if (exattr & 0x30) pad_y = jega.RPSSU;//Set top padding of upper 2x character
+		}
+		if (line >= pad_y && line < 16 + pad_y) {
+			// Check the char code is in Wide charset of Shift-JIS
+			if (jega_row.kind[cell] == JEGA_CELL_DBCS) {
+				Bitu fline = line - pad_y;//Start line of drawing 16x16 character
+				// Fix vertical position
+				chr |= lead << 8;
+				//Horizontal wide font (Extended Attribute)
+				if (exattr & 0x20) {
+					if (exattr & 0x10) fline = (fline >> 1) + 8;
+					else fline = fline >> 1;
+				}
+				//Vertical wide font (Extended Attribute)
+				if (exattr & 0x40) {
+					// Get the font pattern
+					Bitu font = jfont_dbcs_16[chr * 32 + fline * 2];
+					if (!(exattr & 0x08))
+						font = jfont_dbcs_16[chr * 32 + fline * 2 + 1];
+					// Draw 8 dots twice as wide
+					VGA_JEGA_Expand8(draw, JEGA_Double_Table[font >> 4], fg, bg);
+					VGA_JEGA_Expand8(draw + 8, JEGA_Double_Table[font & 0xf], fg, bg);
+				}
+				else {
+					// Get the font pattern
+					Bitu font = jfont_dbcs_16[chr * 32 + fline * 2];
+					font <<= 8;
+					font |= jfont_dbcs_16[chr * 32 + fline * 2 + 1];
+					//Bold (Extended Attribute)
+					if (exattr & 0x80)
+					{
+						font |= font >> 1;
+						//Original JEGA colours the last row with the next column's attribute.
+					}
+					// Draw 16 dots
+					VGA_JEGA_Expand8(draw, (font >> 8) & 0xff, fg, bg);
+					VGA_JEGA_Expand8(draw + 8, font & 0xff, fg, bg);
+				}
+			}
+			// Ignore wide char code, put blank
+			else {
+				VGA_JEGA_Expand8(draw, 0, fg, bg);
+				VGA_JEGA_Expand8(draw + 8, 0, fg, bg);
+			}
+		}
+		else if (line == (17 + pad_y) && (bsattr & 0x10)) {
+			VGA_JEGA_Expand8(draw, 0xff, fg, bg);//underline
+			VGA_JEGA_Expand8(draw + 8, 0xff, fg, bg);
+		}
+		else {
+			VGA_JEGA_Expand8(draw, 0, fg, bg);//draw blank
+			VGA_JEGA_Expand8(draw + 8, 0, fg, bg);
+		}
+		if (bsattr & 0x20) {//vertical line draw at last
+			*draw = fg;
+		}
+		draw += 16;
+		cell += 2;// Move to +2 columns
+	}
 	// draw the text mode cursor if needed
 
 	if ((vga.draw.cursor.count & 0x8) && (line >= vga.draw.cursor.sline) &&
@@ -851,6 +913,50 @@ static void VGA_ProcessSplit() {
 	vga.draw.address_line=0;
 }
 
+void VGA_SetCursorOverlay(Bitu x, Bitu width, Bitu line, Bitu lines) {
+	vga.draw.cursor_overlay.x = x;
+	vga.draw.cursor_overlay.width = width;
+	vga.draw.cursor_overlay.line = line;
+	vga.draw.cursor_overlay.lines = lines;
+	vga.draw.cursor_overlay.enabled = true;
+}
+
+void VGA_ClearCursorOverlay(void) {
+	vga.draw.cursor_overlay.enabled = false;
+}
+
+static INLINE void VGA_XorPixels(Bit8u * pixels, Bitu count, Bit8u value) {
+#if defined(VGA_SSE2)
+	const __m128i mask = _mm_set1_epi8((char)value);
+	for (; count >= 16; count -= 16, pixels += 16) {
+		__m128i data = _mm_loadu_si128((const __m128i *)pixels);
+		_mm_storeu_si128((__m128i *)pixels, _mm_xor_si128(data, mask));
+	}
+#endif
+	for (; count >= 4; count -= 4, pixels += 4) {
+		host_writed(pixels, host_readd(pixels) ^ (value * 0x01010101u));
+	}
+	for (; count > 0; count--) *pixels++ ^= value;
+}
+
+/* The DOS/V and J-3100 text cursor is inverted on the scanline instead of in video memory */
+static Bit8u * VGA_DrawCursorOverlay(Bit8u * data) {
+	Bitu line = vga.draw.lines_done - vga.draw.cursor_overlay.line;
+	if (line >= vga.draw.cursor_overlay.lines || vga.draw.bpp != 8) return data;
+	Bitu x = vga.draw.cursor_overlay.x;
+	Bitu width = vga.draw.cursor_overlay.width;
+	if (x >= vga.draw.width) return data;
+	if (x + width > vga.draw.width) width = vga.draw.width - x;
+	if (data != TempLine) {
+		memmove(TempLine, data, vga.draw.width);
+		data = TempLine;
+	}
+	// inverting every plane swaps the two colors of 1bpp modes and xors the index of 16 color modes
+	Bit8u value = (vga.mode == M_DCGA) ? (Bit8u)(CGA_2_Table[0] ^ CGA_2_Table[15]) : 0x0f;
+	VGA_XorPixels(&data[x], width, value);
+	return data;
+}
+
 static Bit8u bg_color_index = 0; // screen-off black index
 static void VGA_DrawSingleLine(Bitu /*blah*/) {
 	if (GCC_UNLIKELY(vga.attr.disabled)) {
@@ -909,6 +1015,7 @@ static void VGA_DrawSingleLine(Bitu /*blah*/) {
 		RENDER_DrawLine(TempLine);
 	} else {
 		Bit8u * data=VGA_DrawLine( vga.draw.address, vga.draw.address_line );	
+		if (GCC_UNLIKELY(vga.draw.cursor_overlay.enabled)) data=VGA_DrawCursorOverlay(data);
 		RENDER_DrawLine(data);
 	}
 
@@ -932,6 +1039,7 @@ static void VGA_DrawEGASingleLine(Bitu /*blah*/) {
 		Bitu address = vga.draw.address;
 		if (vga.mode!=M_TEXT) address += vga.draw.panning;
 		Bit8u * data=VGA_DrawLine(address, vga.draw.address_line );	
+		if (GCC_UNLIKELY(vga.draw.cursor_overlay.enabled)) data=VGA_DrawCursorOverlay(data);
 		RENDER_DrawLine(data);
 	}
 
@@ -950,6 +1058,7 @@ static void VGA_DrawEGASingleLine(Bitu /*blah*/) {
 static void VGA_DrawPart(Bitu lines) {
 	while (lines--) {
 		Bit8u * data=VGA_DrawLine( vga.draw.address, vga.draw.address_line );
+		if (GCC_UNLIKELY(vga.draw.cursor_overlay.enabled)) data=VGA_DrawCursorOverlay(data);
 		RENDER_DrawLine(data);
 		vga.draw.address_line++;
 		if (vga.draw.address_line>=vga.draw.address_line_total) {
@@ -1040,6 +1149,7 @@ static void VGA_PanningLatch(Bitu /*val*/) {
 static void VGA_VerticalTimer(Bitu /*val*/) {
 	vga.draw.delay.framestart = PIC_FullIndex();
 	PIC_AddEvent( VGA_VerticalTimer, (float)vga.draw.delay.vtotal );
+	DOSV_FlushText();
 	
 	switch(machine) {
 	case MCH_PCJR:
@@ -1693,6 +1803,7 @@ void VGA_SetupDrawing(Bitu /*val*/) {
 			width *= 8;
 			bpp = 16;
 			VGA_DrawLine = VGA_TEXT_JEGA_Draw_Line;
+			VGA_JEGA_InitTables();
 		}
 		else
 			if ((IS_VGA_ARCH || IS_J3_ARCH) && (svgaCard == SVGA_None)) {
@@ -23,6 +23,7 @@
 #include "vga.h"
 #include "inout.h"
 #include "mem.h"
+#include "savestate.h"
 
 JEGA_DATA jega;
 
@@ -234,8 +235,13 @@ void JEGA_setupAX(void) {
 	real_writeb(BIOSMEM_AX_SEG, BIOSMEM_AX_KBDSTATUS, 0x00);
 }
 
+static void JEGA_SaveState(SaveStream & stream) {
+	stream.Pod(jega);
+}
+
 void SVGA_Setup_JEGA(void) {
 	JEGA_setupAX();
+	SAVESTATE_Register("jega",&JEGA_SaveState);
 	svga.write_p3d5 = &write_p3d5_jega;
 	svga.read_p3d5 = &read_p3d5_jega;
 
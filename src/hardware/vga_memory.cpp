@@ -26,6 +26,7 @@
 #include "pic.h"
 #include "inout.h"
 #include "setup.h"
+#include "dosv.h"
 
 
 #ifndef C_VGARAM_CHECKED
@@ -135,6 +136,12 @@ static struct {
 	Bitu base, mask;
 } vgapages;
 	
+/* Text the DOS/V BIOS holds back for the retrace goes to the planes
+   before the guest reads or draws over them */
+static INLINE void FlushDeferredText(void) {
+	if (GCC_UNLIKELY(dosv_dirty_any)) DOSV_FlushText();
+}
+
 class VGA_UnchainedRead_Handler : public PageHandler {
 public:
 	Bitu readHandler(PhysPt start) {
@@ -151,12 +158,14 @@ public:
 	}
 public:
 	Bitu readb(PhysPt addr) {
+		FlushDeferredText();
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_read_full;
 		addr = CHECKED2(addr);
 		return readHandler(addr);
 	}
 	Bitu readw(PhysPt addr) {
+		FlushDeferredText();
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_read_full;
 		addr = CHECKED2(addr);
@@ -165,6 +174,7 @@ public:
 		return  ret;
 	}
 	Bitu readd(PhysPt addr) {
+		FlushDeferredText();
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_read_full;
 		addr = CHECKED2(addr);
@@ -262,6 +272,27 @@ public:
 	}
 };
 
+/* Update the pixel buffer of the 16 color modes from the planes */
+static INLINE void EGA16_ExpandPixels(PhysPt start, Bit32u pixels) {
+	Bit8u * write_pixels=&vga.fastmem[start<<3];
+
+	Bit32u colors0_3, colors4_7;
+	VGA_Latch temp;temp.d=(pixels>>4) & 0x0f0f0f0f;
+		colors0_3 = 
+		Expand16Table[0][temp.b[0]] |
+		Expand16Table[1][temp.b[1]] |
+		Expand16Table[2][temp.b[2]] |
+		Expand16Table[3][temp.b[3]];
+	*(Bit32u *)write_pixels=colors0_3;
+	temp.d=pixels & 0x0f0f0f0f;
+	colors4_7 = 
+		Expand16Table[0][temp.b[0]] |
+		Expand16Table[1][temp.b[1]] |
+		Expand16Table[2][temp.b[2]] |
+		Expand16Table[3][temp.b[3]];
+	*(Bit32u *)(write_pixels+4)=colors4_7;
+}
+
 class VGA_UnchainedEGA_Handler : public VGA_UnchainedRead_Handler {
 public:
 	template< bool wrapping>
@@ -273,29 +304,14 @@ public:
 		pixels.d&=vga.config.full_not_map_mask;
 		pixels.d|=(data & vga.config.full_map_mask);
 		((Bit32u*)vga.mem.linear)[start]=pixels.d;
-		Bit8u * write_pixels=&vga.fastmem[start<<3];
-
-		Bit32u colors0_3, colors4_7;
-		VGA_Latch temp;temp.d=(pixels.d>>4) & 0x0f0f0f0f;
-			colors0_3 = 
-			Expand16Table[0][temp.b[0]] |
-			Expand16Table[1][temp.b[1]] |
-			Expand16Table[2][temp.b[2]] |
-			Expand16Table[3][temp.b[3]];
-		*(Bit32u *)write_pixels=colors0_3;
-		temp.d=pixels.d & 0x0f0f0f0f;
-		colors4_7 = 
-			Expand16Table[0][temp.b[0]] |
-			Expand16Table[1][temp.b[1]] |
-			Expand16Table[2][temp.b[2]] |
-			Expand16Table[3][temp.b[3]];
-		*(Bit32u *)(write_pixels+4)=colors4_7;
+		EGA16_ExpandPixels(start, pixels.d);
 	}
 public:	
 	VGA_UnchainedEGA_Handler()  {
 		flags=PFLAG_NOCODE;
 	}
 	void writeb(PhysPt addr,Bitu val) {
+		FlushDeferredText();
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
@@ -303,6 +319,7 @@ public:
 		writeHandler<true>(addr+0,(Bit8u)(val >> 0));
 	}
 	void writew(PhysPt addr,Bitu val) {
+		FlushDeferredText();
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
@@ -311,6 +328,7 @@ public:
 		writeHandler<true>(addr+1,(Bit8u)(val >> 8));
 	}
 	void writed(PhysPt addr,Bitu val) {
+		FlushDeferredText();
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
@@ -559,12 +577,14 @@ public:
 		flags=PFLAG_NOCODE;
 	}
 	void writeb(PhysPt addr,Bitu val) {
+		FlushDeferredText();
 		addr = vga.svga.bank_write_full + (PAGING_GetPhysicalAddress(addr) & 0xffff);
 		addr = CHECKED4(addr);
 		MEM_CHANGED( addr << 3 );
 		writeHandler<false>(addr+0,(Bit8u)(val >> 0));
 	}
 	void writew(PhysPt addr,Bitu val) {
+		FlushDeferredText();
 		addr = vga.svga.bank_write_full + (PAGING_GetPhysicalAddress(addr) & 0xffff);
 		addr = CHECKED4(addr);
 		MEM_CHANGED( addr << 3 );
@@ -572,6 +592,7 @@ public:
 		writeHandler<false>(addr+1,(Bit8u)(val >> 8));
 	}
 	void writed(PhysPt addr,Bitu val) {
+		FlushDeferredText();
 		addr = vga.svga.bank_write_full + (PAGING_GetPhysicalAddress(addr) & 0xffff);
 		addr = CHECKED4(addr);
 		MEM_CHANGED( addr << 3 );
@@ -581,11 +602,13 @@ public:
 		writeHandler<false>(addr+3,(Bit8u)(val >> 24));
 	}
 	Bitu readb(PhysPt addr) {
+		FlushDeferredText();
 		addr = vga.svga.bank_read_full + (PAGING_GetPhysicalAddress(addr) & 0xffff);
 		addr = CHECKED4(addr);
 		return readHandler(addr);
 	}
 	Bitu readw(PhysPt addr) {
+		FlushDeferredText();
 		addr = vga.svga.bank_read_full + (PAGING_GetPhysicalAddress(addr) & 0xffff);
 		addr = CHECKED4(addr);
 		Bitu ret = (readHandler(addr+0) << 0);
@@ -593,6 +616,7 @@ public:
 		return ret;
 	}
 	Bitu readd(PhysPt addr) {
+		FlushDeferredText();
 		addr = vga.svga.bank_read_full + (PAGING_GetPhysicalAddress(addr) & 0xffff);
 		addr = CHECKED4(addr);
 		Bitu ret = (readHandler(addr+0) << 0);
@@ -777,6 +801,82 @@ static struct vg {
 	VGA_Empty_Handler			empty;
 } vgaph;
 
+/* Direct access to the planes of the unchained 16 color modes, used by the
+   DOS/V BIOS to draw characters. addr is the planar offset including the bank,
+   the result is the same as byte accesses through the page handler. */
+bool VGA_PlanarDirectAccess(void) {
+	if (!IS_VGA_ARCH || paging.enabled || ((vga.gfx.miscellaneous >> 2) & 3) >= 2 || vga.svga.bank_size != 0x10000)
+		return false;
+	return (vga.mode == M_EGA && !vga.config.chained) || vga.mode == M_LIN4;
+}
+
+Bit8u VGA_PlanarReadb(Bitu addr) {
+	return (Bit8u)vgaph.uega.readHandler(CHECKED2(addr));
+}
+
+void VGA_PlanarWriteRows(Bitu addr, Bitu pitch, const Bit8u *data, Bitu bytes, Bitu rows) {
+	for (Bitu y = 0; y < rows; y++) {
+		for (Bitu x = 0; x < bytes; x++) {
+			Bitu start = CHECKED2(addr + x);
+			MEM_CHANGED( start << 3 );
+			vgaph.uega.writeHandler<true>(start, *data++);
+		}
+		addr += pitch;
+	}
+}
+
+/* Copy of all four planes as done by write mode 1 with every plane enabled;
+   the latch is left holding the last source byte. */
+void VGA_PlanarCopyRows(Bitu dest, Bitu src, Bitu pitch, Bitu bytes, Bitu rows) {
+	Bit32u * planes = (Bit32u *)vga.mem.linear;
+	Bitu wrap = vga.vmemwrap >> 2;
+	if (!bytes || !rows) return;
+	for (Bitu y = 0; y < rows; y++) {
+		Bitu d = CHECKED2(dest), s = CHECKED2(src);
+		if (d + bytes <= wrap && s + bytes <= wrap) {
+			memmove(&planes[d], &planes[s], bytes * 4);
+			for (Bitu x = 0; x < bytes; x++) {
+				MEM_CHANGED( (d + x) << 3 );
+				EGA16_ExpandPixels(d + x, planes[d + x]);
+			}
+		} else {
+			for (Bitu x = 0; x < bytes; x++) {
+				Bitu dx = CHECKED2(dest + x);
+				planes[dx] = planes[CHECKED2(src + x)];
+				MEM_CHANGED( dx << 3 );
+				EGA16_ExpandPixels(dx, planes[dx]);
+			}
+		}
+		dest += pitch;
+		src += pitch;
+	}
+	vga.latch.d = planes[CHECKED2(src - pitch + bytes - 1)];
+}
+
+/* Copy of the pixels selected by mask in every plane, the others are kept */
+void VGA_PlanarCopyMask(Bitu dest, Bitu src, Bit8u mask) {
+	Bit32u * planes = (Bit32u *)vga.mem.linear;
+	Bit32u full_mask = ExpandTable[mask];
+	dest = CHECKED2(dest);
+	src = CHECKED2(src);
+	vga.latch.d = planes[src];
+	planes[dest] = (planes[dest] & ~full_mask) | (planes[src] & full_mask);
+	MEM_CHANGED( dest << 3 );
+	EGA16_ExpandPixels(dest, planes[dest]);
+}
+
+/* Pixels in mask get fore where bits is set and back elsewhere, latch and registers untouched */
+void VGA_PlanarPaint(Bitu addr, Bit8u bits, Bit8u mask, Bit8u fore, Bit8u back) {
+	Bit32u * planes = (Bit32u *)vga.mem.linear;
+	Bit32u full_mask = ExpandTable[mask];
+	Bit32u full_bits = ExpandTable[bits];
+	Bit32u color = (FillTable[fore & 0xf] & full_bits) | (FillTable[back & 0xf] & ~full_bits);
+	addr = CHECKED2(addr);
+	planes[addr] = (planes[addr] & ~full_mask) | (color & full_mask);
+	MEM_CHANGED( addr << 3 );
+	EGA16_ExpandPixels(addr, planes[addr]);
+}
+
 void VGA_ChangedBank(void) {
 #ifndef VGA_LFB_MAPPED
 	//If the mode is accurate than the correct mapper must have been installed already
@@ -1141,6 +1141,7 @@ void BIOS_ZeroExtendedSize(bool in) {
 
 void BIOS_SetupKeyboard(void);
 void BIOS_SetupDisks(void);
+void BIOS_FlushDisks(void);
 
 class BIOS:public Module_base{
 private:
@@ -1445,6 +1446,8 @@ public:
 		BIOS_HostTimeSync();
 	}
 	~BIOS(){
+		/* write back cached sectors of disk images */
+		BIOS_FlushDisks();
 		/* abort DAC playing */
 		if (tandy_sb.port) {
 			IO_Write(tandy_sb.port+0xc,0xd3);
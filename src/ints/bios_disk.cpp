@@ -26,6 +26,8 @@
 #include "dos_inc.h" /* for Drives[] */
 #include "../dos/drives.h"
 #include "mapper.h"
+#include "pic.h"
+#include "timer.h"
 
 #if defined(WIN32)
 #define	fseek	_fseeki64
@@ -33,6 +35,14 @@
 
 #define MAX_DISK_IMAGES 4
 
+/* Sectors in a line of the image cache */
+#define IMAGEDISK_LINE	16
+#define IMAGEDISK_NOLINE	0xffffffff
+
+Bitu imagedisk_cachesize;
+Bitu imagedisk_flushdelay;
+static std::vector<imageDisk *> imagedisks;
+
 diskGeo DiskGeometryList[] = {
 	{ 160,  8, 1, 40, 0},
 	{ 180,  9, 1, 40, 0},
@@ -163,15 +173,26 @@ Bit8u imageDisk::Read_Sector(Bit32u head,Bit32u cylinder,Bit32u sector,void * da
 }
 
 Bit8u imageDisk::Read_AbsoluteSector(Bit32u sectnum, void * data) {
-	Bit32u bytenum;
-
-	bytenum = sectnum * sector_size;
-
-	if (last_action==WRITE || bytenum!=current_fpos) fseek(diskimg,bytenum,SEEK_SET);
-	size_t ret=fread(data, 1, sector_size, diskimg);
-	current_fpos=bytenum+ret;
-	last_action=READ;
+	if (!cache.empty()) {
+		bool sequential = (sectnum==last_read+1);
+		last_read = sectnum;
+		Bitu offset = sectnum%IMAGEDISK_LINE;
+		CacheLine * line = GetLine(sectnum);
+		if (!(line->valid & (1u<<offset))) FillLine(line);
+		/* A stream entering a line brings in the next one along with it */
+		if (sequential && offset==0) {
+			CacheLine * next = GetLine(sectnum+IMAGEDISK_LINE);
+			if (!next->valid) FillLine(next);
+			line = GetLine(sectnum);
+		}
+		if (line->valid & (1u<<offset)) {
+			memcpy(data,line->data+offset*sector_size,sector_size);
+			return 0x00;
+		}
+		/* Past the end of the image */
+	}
 
+	FileRead(sectnum * sector_size,data,sector_size);
 	return 0x00;
 }
 
@@ -185,19 +206,202 @@ Bit8u imageDisk::Write_Sector(Bit32u head,Bit32u cylinder,Bit32u sector,void * d
 
 
 Bit8u imageDisk::Write_AbsoluteSector(Bit32u sectnum, void *data) {
-	Bit32u bytenum;
-
-	bytenum = sectnum * sector_size;
+	if (write_protected) return 0x05;
+	if (!cache.empty()) {
+		/* The first write finds out if the image can be written at all,
+		 * a failed write back turns the cache into write through */
+		if (!write_checked || write_failed || !imagedisk_flushdelay)
+			return WriteThrough(sectnum,data);
+		/* Held back until the flush, no need to read the line in */
+		Bitu offset = sectnum%IMAGEDISK_LINE;
+		CacheLine * line = GetLine(sectnum);
+		memcpy(line->data+offset*sector_size,data,sector_size);
+		line->valid |= 1u<<offset;
+		line->dirty |= 1u<<offset;
+		if (!dirty) {
+			dirty = true;
+			dirty_since = PIC_Ticks;
+		}
+		return 0x00;
+	}
 
 	//LOG_MSG("Writing sectors to %ld at bytenum %d", sectnum, bytenum);
 
+	size_t ret=FileWrite(sectnum * sector_size,data,sector_size);
+
+	return ((ret>0)?0x00:0x05);
+
+}
+
+Bit8u imageDisk::WriteThrough(Bit32u sectnum,void * data) {
+	bool first = !write_checked;
+	write_checked = true;
+	if (FileWrite(sectnum * sector_size,data,sector_size)!=sector_size || (first && fflush(diskimg))) {
+		if (first) write_protected = true;
+		return 0x05;
+	}
+	/* Keep a cached copy of the sector in step */
+	std::map<Bit32u,Bitu>::iterator it = cache_index.find(sectnum-sectnum%IMAGEDISK_LINE);
+	if (it!=cache_index.end()) {
+		CacheLine & line = cache[it->second];
+		Bitu offset = sectnum%IMAGEDISK_LINE;
+		memcpy(line.data+offset*sector_size,data,sector_size);
+		line.valid |= 1u<<offset;
+		line.dirty &= ~(1u<<offset);
+	}
+	return 0x00;
+}
+
+size_t imageDisk::FileRead(Bit32u bytenum,void * data,size_t size) {
+	if (last_action==WRITE || bytenum!=current_fpos) fseek(diskimg,bytenum,SEEK_SET);
+	size_t ret=fread(data, 1, size, diskimg);
+	current_fpos=bytenum+ret;
+	last_action=READ;
+	return ret;
+}
+
+size_t imageDisk::FileWrite(Bit32u bytenum,void * data,size_t size) {
 	if (last_action==READ || bytenum!=current_fpos) fseek(diskimg,bytenum,SEEK_SET);
-	size_t ret=fwrite(data, 1, sector_size, diskimg);
+	size_t ret=fwrite(data, 1, size, diskimg);
 	current_fpos=bytenum+ret;
 	last_action=WRITE;
+	return ret;
+}
 
-	return ((ret>0)?0x00:0x05);
+void imageDisk::SetupCache(void) {
+	Flush();
+	if (dirty) LOG_MSG("ImageLoader: written sectors of %s lost",diskname);
+	dirty = write_failed = false;
+	cache.clear();
+	cache_data.clear();
+	cache_index.clear();
+	Bitu lines = imagedisk_cachesize*1024/(IMAGEDISK_LINE*sector_size);
+	if (lines<2) return;
+	cache.resize(lines);
+	cache_data.resize(lines*IMAGEDISK_LINE*sector_size);
+	for (Bitu i=0;i<lines;i++) {
+		cache[i].first = IMAGEDISK_NOLINE;
+		cache[i].valid = cache[i].dirty = 0;
+		cache[i].data = &cache_data[i*IMAGEDISK_LINE*sector_size];
+		cache[i].prev = (i+lines-1)%lines;
+		cache[i].next = (i+1)%lines;
+	}
+	cache_mru = 0;
+	last_read = IMAGEDISK_NOLINE;
+}
 
+void imageDisk::TouchLine(Bitu index) {
+	if (index==cache_mru) return;
+	CacheLine & line = cache[index];
+	cache[line.prev].next = line.next;
+	cache[line.next].prev = line.prev;
+	line.next = cache_mru;
+	line.prev = cache[cache_mru].prev;
+	cache[line.prev].next = index;
+	cache[cache_mru].prev = index;
+	cache_mru = index;
+}
+
+imageDisk::CacheLine * imageDisk::GetLine(Bit32u sectnum) {
+	Bit32u first = sectnum-sectnum%IMAGEDISK_LINE;
+	Bitu index;
+	std::map<Bit32u,Bitu>::iterator it = cache_index.find(first);
+	if (it!=cache_index.end()) index = it->second;
+	else {
+		/* Take over the least recently used line that can be written back */
+		index = cache[cache_mru].prev;
+		for (Bitu i=0;i<cache.size() && cache[index].dirty && !WriteLine(&cache[index]);i++)
+			index = cache[index].prev;
+		CacheLine * line = &cache[index];
+		if (line->dirty) {
+			LOG_MSG("ImageLoader: written sectors of %s lost",diskname);
+			line->dirty = 0;
+		}
+		if (line->first!=IMAGEDISK_NOLINE) cache_index.erase(line->first);
+		line->first = first;
+		line->valid = 0;
+		cache_index[first] = index;
+	}
+	TouchLine(index);
+	return &cache[index];
+}
+
+void imageDisk::FillLine(CacheLine * line) {
+	Bitu size = IMAGEDISK_LINE*sector_size;
+	if (!line->dirty) {
+		size_t ret = FileRead(line->first*sector_size,line->data,size);
+		line->valid = (1u<<(ret/sector_size))-1;
+		return;
+	}
+	/* Sectors written since the line came in stay as they are */
+	std::vector<Bit8u> buffer(size);
+	size_t ret = FileRead(line->first*sector_size,&buffer[0],size);
+	for (Bitu i=0;i<ret/sector_size;i++) {
+		if (line->dirty & (1u<<i)) continue;
+		memcpy(line->data+i*sector_size,&buffer[i*sector_size],sector_size);
+		line->valid |= 1u<<i;
+	}
+}
+
+bool imageDisk::WriteLine(CacheLine * line) {
+	/* Runs of dirty sectors go out in one piece, failed ones stay dirty */
+	for (Bitu i=0;i<IMAGEDISK_LINE;) {
+		if (!(line->dirty & (1u<<i))) {
+			i++;
+			continue;
+		}
+		Bitu end = i;
+		while (end<IMAGEDISK_LINE && (line->dirty & (1u<<end))) end++;
+		size_t size = (end-i)*sector_size;
+		if (FileWrite((line->first+i)*sector_size,line->data+i*sector_size,size)!=size) {
+			if (!write_failed) LOG_MSG("ImageLoader: failed to write back sectors to %s",diskname);
+			write_failed = true;
+			return false;
+		}
+		line->dirty &= ~(((1u<<(end-i))-1)<<i);
+		i = end;
+	}
+	return true;
+}
+
+void imageDisk::Flush(void) {
+	if (!dirty) return;
+	/* The index is sorted, neighbouring lines are written without seeking */
+	bool ok = true;
+	for (std::map<Bit32u,Bitu>::iterator it=cache_index.begin();it!=cache_index.end();++it) {
+		if (cache[it->second].dirty && !WriteLine(&cache[it->second])) ok = false;
+	}
+	if (fflush(diskimg)) ok = false;
+	if (!ok) {
+		/* Retried after the next delay */
+		dirty_since = PIC_Ticks;
+		return;
+	}
+	dirty = false;
+	write_failed = false;
+}
+
+void imageDisk::CheckFlush(void) {
+	if (dirty && PIC_Ticks-dirty_since>=imagedisk_flushdelay) Flush();
+}
+
+static void IMAGEDISK_TickHandler(void) {
+	for (Bitu i=0;i<imagedisks.size();i++) imagedisks[i]->CheckFlush();
+}
+
+void BIOS_FlushDisks(void) {
+	for (Bitu i=0;i<imagedisks.size();i++) imagedisks[i]->Flush();
+}
+
+imageDisk::~imageDisk() {
+	Flush();
+	for (Bitu i=0;i<imagedisks.size();i++) {
+		if (imagedisks[i]==this) {
+			imagedisks.erase(imagedisks.begin()+i);
+			break;
+		}
+	}
+	if(diskimg != NULL) { fclose(diskimg); }
 }
 
 imageDisk::imageDisk(FILE *imgFile, Bit8u *imgName, Bit32u imgSizeK, bool isHardDisk) {
@@ -209,6 +413,10 @@ imageDisk::imageDisk(FILE *imgFile, Bit8u *imgName, Bit32u imgSizeK, bool isHard
 	last_action = NONE;
 	diskimg = imgFile;
 	fseek(diskimg,0,SEEK_SET);
+	dirty = false;
+	write_checked = write_protected = write_failed = false;
+	SetupCache();
+	imagedisks.push_back(this);
 	
 	memset(diskname,0,512);
 	if(strlen((const char *)imgName) > 511) {
@@ -263,7 +471,12 @@ void imageDisk::Set_Geometry(Bit32u setHeads, Bit32u setCyl, Bit32u setSect, Bit
 	heads = setHeads;
 	cylinders = setCyl;
 	sectors = setSect;
-	sector_size = setSectSize;
+	if (sector_size != setSectSize) {
+		/* Lines are made of whole sectors */
+		Flush();
+		sector_size = setSectSize;
+		SetupCache();
+	}
 	active = true;
 }
 
@@ -633,6 +846,7 @@ void BIOS_SetupDisks(void) {
 	call_int13=CALLBACK_Allocate();	
 	CALLBACK_Setup(call_int13,&INT13_DiskHandler,CB_INT13,"Int 13 Bios disk");
 	RealSetVec(0x13,CALLBACK_RealPointer(call_int13));
+	TIMER_AddTickHandler(&IMAGEDISK_TickHandler);
 	int i;
 	for(i=0;i<4;i++) {
 		imageDiskList[i] = NULL;
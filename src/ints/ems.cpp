@@ -32,6 +32,7 @@
 #include "support.h"
 #include "cpu.h"
 #include "dma.h"
+#include "savestate.h"
 
 #define EMM_PAGEFRAME		0xE000
 #define EMM_PAGEFRAME_J3	0xD000
@@ -1460,6 +1461,13 @@ public:
 		
 static EMS* test;
 
+static void EMS_SaveState(SaveStream & stream) {
+	/* The frame pages themselves are part of the paging state */
+	stream.Pod(emm_handles);
+	stream.Pod(emm_mappings);
+	stream.Pod(emm_segmentmappings);
+}
+
 void EMS_ShutDown(Section* /*sec*/) {
 	delete test;	
 }
@@ -1468,6 +1476,7 @@ void EMS_Init(Section* sec) {
 	emm_pageframe = IS_J3_ARCH ? EMM_PAGEFRAME_J3 : EMM_PAGEFRAME;
 	test = new EMS(sec);
 	sec->AddDestroyFunction(&EMS_ShutDown,true);
+	SAVESTATE_Register("ems",&EMS_SaveState);
 }
 
 //Initialize static members
@@ -30,6 +30,7 @@
 #include "int10.h"
 #include "mouse.h"
 #include "setup.h"
+#include "savestate.h"
 
 Int10Data int10;
 static Bitu call_10;
@@ -1142,6 +1143,12 @@ static void SetupTandyBios(void) {
 	}
 }
 
+static void INT10_SaveState(SaveStream & stream) {
+	stream.Pod(int10);
+	/* The mode table entry follows the mode in the bios data area */
+	if (stream.loading) INT10_SetCurMode();
+}
+
 void INT10_Init(Section* /*sec*/) {
 	INT10_InitVGA();
 	if (IS_TANDY_ARCH) SetupTandyBios();
@@ -1154,4 +1161,5 @@ void INT10_Init(Section* /*sec*/) {
 	INT10_Seg40Init();
 	INT10_SetVideoMode(0x3);
 	SetTrueVideoMode(0x03);
+	SAVESTATE_Register("int10",&INT10_SaveState);
 }
@@ -110,6 +110,14 @@ static void EGA16_CopyRow(Bit8u cleft,Bit8u cright,Bit8u rold,Bit8u rnew,PhysPt
 	/* Setup registers correctly */
 	IO_Write(0x3ce,5);IO_Write(0x3cf,1);		/* Memory transfer mode */
 	IO_Write(0x3c4,2);IO_Write(0x3c5,0xf);		/* Enable all Write planes */
+	if(svgaCard == SVGA_TsengET4K && base == 0xa0000 && VGA_PlanarDirectAccess() &&
+			src + (cheight - 1) * nextline + rowsize <= 0x30000 && dest + (cheight - 1) * nextline + rowsize <= 0x30000) {
+		/* Planar offsets run on across the 64K banks */
+		VGA_PlanarCopyRows(dest, src, nextline, rowsize, cheight);
+		IO_Write(0x3ce,5);IO_Write(0x3cf,0);
+		IO_Write(0x3cd, 0);
+		return;
+	}
 	/* Do some copying */
 	Bit8u select;
 	if(svgaCard == SVGA_TsengET4K) {
@@ -209,6 +217,41 @@ static void EGA16_CopyRow_24(Bit8u cleft,Bit8u cright,Bit8u rold,Bit8u rnew,Phys
 	src = (width * rold) * 24 + start;
 	IO_Write(0x3ce,5); IO_Write(0x3cf,1);
 	IO_Write(0x3c4,2); IO_Write(0x3c5,0xf);
+	if(svgaCard == SVGA_TsengET4K && base == 0xa0000 && VGA_PlanarDirectAccess() &&
+			src + 23 * width + rowsize <= 0x30000 && dest + 23 * width + rowsize <= 0x30000) {
+		bool masked = false;
+		for(Bitu copy = 0 ; copy < 24 ; copy++) {
+			Bitu first = 0;
+			Bitu last = rowsize;
+			if(cleft & 1) {
+				VGA_PlanarCopyMask(dest, src, 0x0f);
+				first = 1;
+				masked = true;
+			}
+			if((cright & 1) && rowsize >= first + 1) {
+				last = rowsize - 1;
+			}
+			VGA_PlanarCopyRows(dest + first, src + first, 0, last - first, 1);
+			if(last < rowsize) {
+				VGA_PlanarCopyMask(dest + last, src + last, 0xf0);
+				masked = true;
+			}
+			dest += width;
+			src += width;
+		}
+		if(masked) {
+			/* Registers as left by CopyRowMask */
+			IO_Write(0x3ce, 4); IO_Write(0x3cf, 3);
+			IO_Write(0x3ce, 1); IO_Write(0x3cf, 0);
+			IO_Write(0x3ce, 7); IO_Write(0x3cf, 0);
+			IO_Write(0x3ce, 3); IO_Write(0x3cf, 0);
+			IO_Write(0x3ce, 8); IO_Write(0x3cf, 0xff);
+			IO_Write(0x3c4, 2); IO_Write(0x3c5, 0xf);
+		}
+		IO_Write(0x3ce,5);IO_Write(0x3cf,0);
+		IO_Write(0x3cd, 0);
+		return;
+	}
 	Bit8u select;
 	select = 0x00;
 	if(src >= 0x20000) {
@@ -408,6 +451,7 @@ void INT10_ScrollWindow(Bit8u rul,Bit8u cul,Bit8u rlr,Bit8u clr,Bit8s nlines,Bit
 		J3_OffCursor();
 	} else if((IS_J3_ARCH || IS_DOSV) && DOSV_CheckJapaneseVideoMode()) {
 		DOSV_OffCursor();
+		DOSV_FlushText();
 	}
 	if (CurMode->type!=M_TEXT) page=0xff;
 	BIOS_NCOLS;BIOS_NROWS;
@@ -1069,6 +1113,42 @@ static bool CheckJapaneseGraphicsMode(Bit8u attr)
 	return false;
 }
 
+// Same registers and planes as the write mode 3 loops in WriteCharDOSVSbcs and
+// WriteCharDOSVDbcs, but the glyph is written to the planes directly (ET4000).
+static bool WriteGlyphDOSVDirect(Bitu start, Bitu width, const Bit8u *font, Bitu bytes, Bitu height, Bit8u attr)
+{
+	static const Bit8u fill[2] = { 0xff, 0xff };
+	Bitu end = start + height * width;
+	Bit8u select;
+
+	if(svgaCard != SVGA_TsengET4K || !VGA_PlanarDirectAccess() || end >= 0x30000) {
+		return false;
+	}
+	if(bytes == 2) {
+		// a word at ffffh is split across the end of the window
+		for(Bitu h = 0 ; h < height ; h++) {
+			if(((start + h * width) & 0xffff) == 0xffff) {
+				return false;
+			}
+		}
+	}
+	select = (Bit8u)((start >> 16) * 0x11);
+	IO_Write(0x3cd, select);
+	IO_Write(0x3ce, 0x05); IO_Write(0x3cf, 0x03);
+	IO_Write(0x3ce, 0x00); IO_Write(0x3cf, attr >> 4);
+	VGA_PlanarWriteRows(start, 0, fill, bytes, 1);
+	VGA_PlanarReadb(start);
+	if(bytes == 2) {
+		VGA_PlanarReadb(start + 1);
+	}
+	IO_Write(0x3ce, 0x00); IO_Write(0x3cf, attr & 0x0f);
+	VGA_PlanarWriteRows(start, width, font, bytes, height);
+	if((end >> 16) * 0x11 != select) {
+		IO_Write(0x3cd, (end >> 16) * 0x11);
+	}
+	return true;
+}
+
 void WriteCharDOSVSbcs24(Bit16u col, Bit16u row, Bit8u chr, Bit8u attr)
 {
 	Bit8u back, data, select;
@@ -1199,12 +1279,12 @@ void WriteCharDOSVSbcs24(Bit16u col, Bit16u row, Bit8u chr, Bit8u attr)
 void WriteCharDOSVDbcs24(Bit16u col, Bit16u row, Bit16u chr, Bit8u attr)
 {
 	Bit8u back, select;
-	Bit8u *font;
+	const Bit8u *font;
 	Bitu off;
 	Bitu width = (real_readw(BIOSMEM_SEG, BIOSMEM_NB_COLS) == 85) ? 128 : 160;
 	volatile Bit8u dummy;
 
-	font = GetDbcs24Font(chr);
+	font = GetDbcs24Glyph(chr);
 
 	back = attr >> 4;
 	attr &= 0x0f;
@@ -1452,6 +1532,9 @@ void WriteCharDOSVSbcs(Bit16u col, Bit16u row, Bit8u chr, Bit8u attr)
 		font = GetSbcs19Font(chr);
 	}
 	off = row * width * height + col;
+	if(WriteGlyphDOSVDirect(off, width, font, 1, height, attr)) {
+		return;
+	}
 	if(svgaCard == SVGA_TsengET4K) {
 		if(off >= 0x20000) {
 			select = 0x22;
@@ -1488,7 +1571,7 @@ void WriteCharDOSVDbcs(Bit16u col, Bit16u row, Bit16u chr, Bit8u attr)
 {
 	Bitu off;
 	Bit16u data;
-	Bit16u *font;
+	const Bit16u *font;
 	Bit8u select;
 
 	if(real_readb(BIOSMEM_SEG, BIOSMEM_CHAR_HEIGHT) == 24) {
@@ -1504,7 +1587,7 @@ void WriteCharDOSVDbcs(Bit16u col, Bit16u row, Bit16u chr, Bit8u attr)
 		volatile Bit16u dummy;
 		Bitu width = real_readw(BIOSMEM_SEG, BIOSMEM_NB_COLS);
 		Bit8u height = real_readb(BIOSMEM_SEG, BIOSMEM_CHAR_HEIGHT);
-		font = (Bit16u *)GetDbcsFont(chr);
+		font = (const Bit16u *)GetDbcsGlyph(chr);
 		off = row * width * height + col;
 		if(svgaCard == SVGA_TsengET4K) {
 			if(off >= 0x20000) {
@@ -1534,8 +1617,18 @@ void WriteCharDOSVDbcs(Bit16u col, Bit16u row, Bit16u chr, Bit8u attr)
 	volatile Bit16u dummy;
 	Bitu width = real_readw(BIOSMEM_SEG, BIOSMEM_NB_COLS);
 	Bit8u height = real_readb(BIOSMEM_SEG, BIOSMEM_CHAR_HEIGHT);
-	font = (Bit16u *)GetDbcsFont(chr);
+	font = (const Bit16u *)GetDbcsGlyph(chr);
 	off = row * width * height + col;
+	if(height == 19) {
+		Bit8u rows[19 * 2];
+		memset(rows, 0, sizeof(rows));
+		memcpy(&rows[2], font, 16 * 2);
+		if(WriteGlyphDOSVDirect(off, width, rows, 2, height, attr)) {
+			return;
+		}
+	} else if(WriteGlyphDOSVDirect(off, width, (const Bit8u *)font, 2, height, attr)) {
+		return;
+	}
 	if(svgaCard == SVGA_TsengET4K) {
 		if(off >= 0x20000) {
 			select = 0x22;
@@ -1619,6 +1712,182 @@ void WriteCharTopView(Bit16u off, int count)
 	}
 }
 
+#define DOSV_DIRTY_COLS		160
+#define DOSV_DIRTY_ROWS		64
+
+// Cells written to the DOS/V text buffer but not yet painted (vtextdeferred=true)
+static Bit32u dosv_dirty[DOSV_DIRTY_ROWS][DOSV_DIRTY_COLS / 32];
+static bool dosv_dirty_rows[DOSV_DIRTY_ROWS];
+bool dosv_dirty_any = false;
+static Bit8u dosv_dirty_mode;
+
+static void ClearDOSVDirty()
+{
+	memset(dosv_dirty, 0, sizeof(dosv_dirty));
+	memset(dosv_dirty_rows, 0, sizeof(dosv_dirty_rows));
+	dosv_dirty_any = false;
+}
+
+static void SetDOSVDirty(Bitu col, Bitu row)
+{
+	dosv_dirty[row][col >> 5] |= 1u << (col & 31);
+	dosv_dirty_rows[row] = true;
+	dosv_dirty_any = true;
+}
+
+static bool IsDOSVDirty(Bitu col, Bitu row)
+{
+	return (dosv_dirty[row][col >> 5] & (1u << (col & 31))) != 0;
+}
+
+// Returns false when the cells have to be painted right away
+static bool DeferDOSVText(Bit16u col, Bit16u row, Bitu count, Bit8u attr)
+{
+	if(!DOSV_GetVtextDeferred()) {
+		return false;
+	}
+	Bit8u mode = real_readb(BIOSMEM_SEG, BIOSMEM_CURRENT_MODE);
+	if(svgaCard != SVGA_TsengET4K || CheckJapaneseGraphicsMode(attr) || !VGA_PlanarDirectAccess()
+			|| col + count > DOSV_DIRTY_COLS || row >= DOSV_DIRTY_ROWS) {
+		DOSV_FlushText();
+		return false;
+	}
+	if(dosv_dirty_any && dosv_dirty_mode != mode) {
+		ClearDOSVDirty();
+	}
+	dosv_dirty_mode = mode;
+	while(count-- > 0) {
+		SetDOSVDirty(col++, row);
+	}
+	return true;
+}
+
+// Same pixels as WriteCharDOSVSbcs/Dbcs and their 24 dot versions, written to the planes directly
+static void PaintDOSVCell(Bitu col, Bitu row, Bitu cells, const Bit8u *font, Bit8u attr, Bitu width, Bitu height)
+{
+	Bit8u fore = attr & 0x0f;
+	Bit8u back = attr >> 4;
+	if(height == 24) {
+		Bitu pitch = (width == 85) ? 128 : 160;
+		Bitu off = row * pitch * 24 + (col * 12) / 8;
+		Bitu shift = (col & 1) ? 4 : 0;
+		for(Bitu y = 0 ; y < 24 ; y++) {
+			Bit32u line = ((Bit32u)font[0] << 24) | ((Bit32u)font[1] << 16);
+			Bit32u mask = 0xfff00000;
+			if(cells == 2) {
+				line |= (Bit32u)font[2] << 8;
+				mask = 0xffffff00;
+			}
+			font += cells + 1;
+			line >>= shift;
+			mask >>= shift;
+			for(Bitu x = 0 ; mask != 0 ; x++) {
+				VGA_PlanarPaint(off + x, (Bit8u)(line >> 24), (Bit8u)(mask >> 24), fore, back);
+				line <<= 8;
+				mask <<= 8;
+			}
+			off += pitch;
+		}
+		return;
+	}
+	Bitu off = row * width * height + col;
+	for(Bitu h = 0 ; h < height ; h++) {
+		for(Bitu x = 0 ; x < cells ; x++) {
+			Bit8u data = 0;
+			if(cells == 1) {
+				data = font[h];
+			} else if(height != 19) {
+				data = font[h * 2 + x];
+			} else if(h > 0 && h <= 16) {
+				data = font[(h - 1) * 2 + x];
+			}
+			VGA_PlanarPaint(off + x, data, 0xff, fore, back);
+		}
+		off += width;
+	}
+}
+
+// Called from the vertical retrace and before anything that reads back the screen
+void DOSV_FlushText()
+{
+	if(!dosv_dirty_any) {
+		return;
+	}
+	if(real_readb(BIOSMEM_SEG, BIOSMEM_CURRENT_MODE) != dosv_dirty_mode || !DOSV_CheckJapaneseVideoMode()) {
+		ClearDOSVDirty();
+		return;
+	}
+	if(!VGA_PlanarDirectAccess()) {
+		return;
+	}
+	Bit16u seg = GetTextSeg();
+	Bitu width = real_readw(BIOSMEM_SEG, BIOSMEM_NB_COLS);
+	Bitu height = real_readb(BIOSMEM_SEG, BIOSMEM_CHAR_HEIGHT);
+	if(width > DOSV_DIRTY_COLS) {
+		width = DOSV_DIRTY_COLS;
+	}
+	for(Bitu row = 0 ; row < DOSV_DIRTY_ROWS ; row++) {
+		if(!dosv_dirty_rows[row]) {
+			continue;
+		}
+		// walk the whole row so that kanji pairs are found as WriteCharTopView does
+		Bitu off = row * real_readw(BIOSMEM_SEG, BIOSMEM_NB_COLS) * 2;
+		for(Bitu col = 0 ; col < width ; ) {
+			Bit8u code = real_readb(seg, off + col * 2);
+			Bit8u attr = real_readb(seg, off + col * 2 + 1);
+			if(isKanji1(code) && col + 1 < width && isKanji2(real_readb(seg, off + col * 2 + 2))) {
+				if(IsDOSVDirty(col, row) || IsDOSVDirty(col + 1, row)) {
+					Bit16u chr = ((Bit16u)code << 8) | real_readb(seg, off + col * 2 + 2);
+					PaintDOSVCell(col, row, 2, (height == 24) ? GetDbcs24Glyph(chr) : GetDbcsGlyph(chr), attr, width, height);
+				}
+				col += 2;
+			} else {
+				if(IsDOSVDirty(col, row)) {
+					const Bit8u *font;
+					if(height == 24) {
+						font = GetSbcs24Font(code);
+					} else if(height == 16) {
+						font = GetSbcsFont(code);
+					} else {
+						font = GetSbcs19Font(code);
+					}
+					PaintDOSVCell(col, row, 1, font, attr, width, height);
+				}
+				col++;
+			}
+		}
+	}
+	ClearDOSVDirty();
+}
+
+// Repaint the DOS/V screen from the text buffer on the next flush (after a state is loaded)
+void DOSV_MarkTextDirty()
+{
+	if(!IS_DOSV || svgaCard != SVGA_TsengET4K || !DOSV_CheckJapaneseVideoMode()) {
+		return;
+	}
+	Bit16u seg = GetTextSeg();
+	Bitu width = real_readw(BIOSMEM_SEG, BIOSMEM_NB_COLS);
+	Bitu rows = real_readb(BIOSMEM_SEG, BIOSMEM_NB_ROWS) + 1;
+	Bitu pitch = width * 2;
+	if(width > DOSV_DIRTY_COLS) {
+		width = DOSV_DIRTY_COLS;
+	}
+	if(rows > DOSV_DIRTY_ROWS) {
+		rows = DOSV_DIRTY_ROWS;
+	}
+	ClearDOSVDirty();
+	dosv_dirty_mode = real_readb(BIOSMEM_SEG, BIOSMEM_CURRENT_MODE);
+	for(Bitu row = 0 ; row < rows ; row++) {
+		for(Bitu col = 0 ; col < width ; col++) {
+			// cells drawn with xor can't be painted again
+			if(!CheckJapaneseGraphicsMode(real_readb(seg, row * pitch + col * 2 + 1))) {
+				SetDOSVDirty(col, row);
+			}
+		}
+	}
+}
+
 void WriteChar(Bit16u col,Bit16u row,Bit8u page,Bit8u chr,Bit8u attr,bool useattr) {
 	/* Externally used by the mouse routine */
 	PhysPt fontdata;
@@ -1701,11 +1970,15 @@ void WriteChar(Bit16u col,Bit16u row,Bit8u page,Bit8u chr,Bit8u attr,bool useatt
 			if (isKanji1(chr) && prevchr == 0) {
 				prevchr = chr;
 			} else if (isKanji2(chr) && prevchr != 0) {
-				WriteCharDOSVDbcs(col - 1, row, (prevchr << 8) | chr, attr);
+				if(!DeferDOSVText(col - 1, row, 2, attr)) {
+					WriteCharDOSVDbcs(col - 1, row, (prevchr << 8) | chr, attr);
+				}
 				prevchr = 0;
 				return;
 			}
-			WriteCharDOSVSbcs(col, row, chr, attr);
+			if(!DeferDOSVText(col, row, 1, attr)) {
+				WriteCharDOSVSbcs(col, row, chr, attr);
+			}
 			return;
 		}
 		fontdata=Real2Phys(RealGetVec(0x43));
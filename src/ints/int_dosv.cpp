@@ -31,6 +31,8 @@
 #include "jfont.h"
 #include "dosv.h"
 #include "dos_inc.h"
+#include "vga.h"
+#include "savestate.h"
 
 #define	VTEXT_MODE_COUNT	2
 
@@ -42,6 +44,7 @@ static Bitu dosv_cursor_x;
 static Bitu dosv_cursor_y;
 static enum DOSV_VTEXT_MODE dosv_vtext_mode[VTEXT_MODE_COUNT];
 static enum DOSV_FEP_CTRL dosv_fep_ctrl;
+static bool dosv_vtext_deferred;
 Bit8u TrueVideoMode;
 
 Bit8u GetTrueVideoMode()
@@ -99,12 +102,7 @@ static Bitu font8x19(void)
 
 static Bitu font16x16(void)
 {
-	PhysPt data	= PhysMake(SegValue(es), reg_si);
-	Bit16u *font = (Bit16u *)GetDbcsFont(reg_cx);
-	for(Bitu ct = 0 ; ct < 16 ; ct++) {
-		mem_writew(data, *font++);
-		data += 2;
-	}
+	MEM_BlockWrite(PhysMake(SegValue(es), reg_si), GetDbcsGlyph(reg_cx), 32);
 	reg_al = 0x00;
 	return CBRET_NONE;
 }
@@ -123,13 +121,7 @@ static Bitu font12x24(void)
 
 static Bitu font24x24(void)
 {
-	PhysPt data	= PhysMake(SegValue(es), reg_si);
-	Bit8u *font = GetDbcs24Font(reg_cx);
-	for(Bitu ct = 0 ; ct < 24 ; ct++) {
-		mem_writeb(data++, *font++);
-		mem_writeb(data++, *font++);
-		mem_writeb(data++, *font++);
-	}
+	MEM_BlockWrite(PhysMake(SegValue(es), reg_si), GetDbcs24Glyph(reg_cx), 72);
 	reg_al = 0x00;
 	return CBRET_NONE;
 }
@@ -230,235 +222,39 @@ static Bitu dosv_cursor_16[] = {
 	0, 3, 5, 7, 9, 11, 13, 15
 };
 
-void DOSV_CursorXor24(Bitu x, Bitu y, Bitu start, Bitu end)
-{
-	IO_Write(0x3ce, 0x05); IO_Write(0x3cf, 0x03);
-	IO_Write(0x3ce, 0x00); IO_Write(0x3cf, 0x0f);
-	IO_Write(0x3ce, 0x03); IO_Write(0x3cf, 0x18);
-
-	Bitu width = (real_readw(BIOSMEM_SEG, BIOSMEM_NB_COLS) == 85) ? 128 : 160;
-	volatile Bit8u dummy;
-	Bitu off = (y + start) * width + (x * 12) / 8;
-	Bit8u select;
-	if(svgaCard == SVGA_TsengET4K) {
-		if(off >= 0x20000) {
-			select = 0x22;
-			off -= 0x20000;
-		} else if(off >= 0x10000) {
-			select = 0x11;
-			off -= 0x10000;
-		} else {
-			select = 0x00;
-		}
-		IO_Write(0x3cd, select);
-	}
-	while(start <= end) {
-		if(dosv_cursor_stat == 2) {
-			if(x & 1) {
-				dummy = real_readb(0xa000, off);
-				real_writeb(0xa000, off, 0x0f);
-				off++;
-				if(off >= 0x10000) {
-					if(select == 0x00) {
-						select = 0x11;
-					} else if(select == 0x11) {
-						select = 0x22;
-					}
-					IO_Write(0x3cd, select);
-					off -= 0x10000;
-				}
-				dummy = real_readb(0xa000, off);
-				real_writeb(0xa000, off, 0xff);
-				off++;
-				if(off >= 0x10000) {
-					if(select == 0x00) {
-						select = 0x11;
-					} else if(select == 0x11) {
-						select = 0x22;
-					}
-					IO_Write(0x3cd, select);
-					off -= 0x10000;
-				}
-				dummy = real_readb(0xa000, off);
-				real_writeb(0xa000, off, 0xff);
-				off++;
-				if(off >= 0x10000) {
-					if(select == 0x00) {
-						select = 0x11;
-					} else if(select == 0x11) {
-						select = 0x22;
-					}
-					IO_Write(0x3cd, select);
-					off -= 0x10000;
-				}
-				dummy = real_readb(0xa000, off);
-				real_writeb(0xa000, off, 0xf0);
-				off += width - 3;
-			} else {
-				dummy = real_readb(0xa000, off);
-				real_writeb(0xa000, off, 0xff);
-				off++;
-				if(off >= 0x10000) {
-					if(select == 0x00) {
-						select = 0x11;
-					} else if(select == 0x11) {
-						select = 0x22;
-					}
-					IO_Write(0x3cd, select);
-					off -= 0x10000;
-				}
-				dummy = real_readb(0xa000, off);
-				real_writeb(0xa000, off, 0xff);
-				off++;
-				if(off >= 0x10000) {
-					if(select == 0x00) {
-						select = 0x11;
-					} else if(select == 0x11) {
-						select = 0x22;
-					}
-					IO_Write(0x3cd, select);
-					off -= 0x10000;
-				}
-				dummy = real_readb(0xa000, off);
-				real_writeb(0xa000, off, 0xff);
-				off += width - 2;
-			}
-		} else {
-			if(x & 1) {
-				dummy = real_readb(0xa000, off);
-				real_writeb(0xa000, off, 0x0f);
-				off++;
-				if(off >= 0x10000) {
-					if(select == 0x00) {
-						select = 0x11;
-					} else if(select == 0x11) {
-						select = 0x22;
-					}
-					IO_Write(0x3cd, select);
-					off -= 0x10000;
-				}
-				dummy = real_readb(0xa000, off);
-				real_writeb(0xa000, off, 0xff);
-			} else {
-				dummy = real_readb(0xa000, off);
-				real_writeb(0xa000, off, 0xff);
-				off++;
-				if(off >= 0x10000) {
-					if(select == 0x00) {
-						select = 0x11;
-					} else if(select == 0x11) {
-						select = 0x22;
-					}
-					IO_Write(0x3cd, select);
-					off -= 0x10000;
-				}
-				dummy = real_readb(0xa000, off);
-				real_writeb(0xa000, off, 0xf0);
-			}
-			off += width - 1;
-		}
-		if(svgaCard == SVGA_TsengET4K) {
-			if(off >= 0x10000) {
-				if(select == 0x00) {
-					select = 0x11;
-				} else if(select == 0x11) {
-					select = 0x22;
-				}
-				IO_Write(0x3cd, select);
-				off -= 0x10000;
-			}
-		}
-		start++;
-	}
-	IO_Write(0x3ce, 0x03); IO_Write(0x3cf, 0x00);
-	if(svgaCard == SVGA_TsengET4K) {
-		IO_Write(0x3cd, 0);
-	}
-}
-
-void DOSV_CursorXor(Bitu x, Bitu y)
-{
-	Bitu end = real_readb(BIOSMEM_SEG, BIOSMEM_CURSOR_TYPE);
-	Bitu start = real_readb(BIOSMEM_SEG, BIOSMEM_CURSOR_TYPE + 1);
-
-	if(start != 0x20 && start <= end) {
-		Bitu width = real_readw(BIOSMEM_SEG,BIOSMEM_NB_COLS);
-		Bit16u height = real_readw(BIOSMEM_SEG, BIOSMEM_CHAR_HEIGHT);
-		if(height == 24) {
-			if(start < 8) start = dosv_cursor_24[start];
-			if(end < 8) end = dosv_cursor_24[end];
-			DOSV_CursorXor24(x, y, start, end);
-			return;
-		} else if(height == 19) {
-			if(start < 8) start = dosv_cursor_19[start];
-			if(end < 8) end = dosv_cursor_19[end];
-		} else if(height == 16) {
-			if(start < 8) start = dosv_cursor_16[start];
-			if(end < 8) end = dosv_cursor_16[end];
-		}
-		IO_Write(0x3ce, 0x05); IO_Write(0x3cf, 0x03);
-		IO_Write(0x3ce, 0x00); IO_Write(0x3cf, 0x0f);
-		IO_Write(0x3ce, 0x03); IO_Write(0x3cf, 0x18);
-
-		volatile Bit8u dummy;
-		Bitu off = (y + start) * width + x;
-		Bit8u select;
-		if(svgaCard == SVGA_TsengET4K) {
-			if(off >= 0x20000) {
-				select = 0x22;
-				off -= 0x20000;
-			} else if(off >= 0x10000) {
-				select = 0x11;
-				off -= 0x10000;
-			} else {
-				select = 0x00;
-			}
-			IO_Write(0x3cd, select);
-		}
-		while(start <= end) {
-			dummy = real_readb(0xa000, off);
-			real_writeb(0xa000, off, 0xff);
-			if(dosv_cursor_stat == 2) {
-				off++;
-				if(off >= 0x10000) {
-					if(select == 0x00) {
-						select = 0x11;
-					} else if(select == 0x11) {
-						select = 0x22;
-					}
-					IO_Write(0x3cd, select);
-					off -= 0x10000;
-				}
-				dummy = real_readb(0xa000, off);
-				real_writeb(0xa000, off, 0xff);
-				off += width - 1;
-			} else {
-				off += width;
-			}
-			if(svgaCard == SVGA_TsengET4K) {
-				if(off >= 0x10000) {
-					if(select == 0x00) {
-						select = 0x11;
-					} else if(select == 0x11) {
-						select = 0x22;
-					}
-					IO_Write(0x3cd, select);
-					off -= 0x10000;
-				}
-			}
-			start++;
-		}
-		IO_Write(0x3ce, 0x03); IO_Write(0x3cf, 0x00);
-		if(svgaCard == SVGA_TsengET4K) {
-			IO_Write(0x3cd, 0);
-		}
-	}
-}
-
+// The cursor is composited by the renderer, video memory is left alone
+static void DOSV_DrawCursor24(Bitu x, Bitu y, Bitu start, Bitu end)
+{
+	VGA_SetCursorOverlay(x * 12, (dosv_cursor_stat == 2) ? 24 : 12, y + start, end - start + 1);
+}
+
+static void DOSV_DrawCursor(Bitu x, Bitu y)
+{
+	Bitu end = real_readb(BIOSMEM_SEG, BIOSMEM_CURSOR_TYPE);
+	Bitu start = real_readb(BIOSMEM_SEG, BIOSMEM_CURSOR_TYPE + 1);
+
+	if(start != 0x20 && start <= end) {
+		Bit16u height = real_readw(BIOSMEM_SEG, BIOSMEM_CHAR_HEIGHT);
+		if(height == 24) {
+			if(start < 8) start = dosv_cursor_24[start];
+			if(end < 8) end = dosv_cursor_24[end];
+			DOSV_DrawCursor24(x, y, start, end);
+			return;
+		} else if(height == 19) {
+			if(start < 8) start = dosv_cursor_19[start];
+			if(end < 8) end = dosv_cursor_19[end];
+		} else if(height == 16) {
+			if(start < 8) start = dosv_cursor_16[start];
+			if(end < 8) end = dosv_cursor_16[end];
+		}
+		VGA_SetCursorOverlay(x * 8, (dosv_cursor_stat == 2) ? 16 : 8, y + start, end - start + 1);
+	}
+}
+
 void DOSV_OffCursor()
 {
 	if(dosv_cursor_stat) {
-		DOSV_CursorXor(dosv_cursor_x, dosv_cursor_y);
+		VGA_ClearCursorOverlay();
 		dosv_cursor_stat = 0;
 	}
 }
@@ -484,7 +280,7 @@ void INT8_DOSV()
 			}
 			dosv_cursor_x = x;
 			dosv_cursor_y = y;
-			DOSV_CursorXor(x, y);
+			DOSV_DrawCursor(x, y);
 		}
 	}
 }
@@ -532,10 +328,31 @@ void DOSV_SetConfig(Section_prop *section)
 	}
 	dosv_vtext_mode[0] = DOSV_StringVtextMode(section->Get_string("vtext"));
 	dosv_vtext_mode[1] = DOSV_StringVtextMode(section->Get_string("vtext2"));
+	dosv_vtext_deferred = section->Get_bool("vtextdeferred");
+}
+
+bool DOSV_GetVtextDeferred()
+{
+	return dosv_vtext_deferred;
+}
+
+static void DOSV_SaveState(SaveStream & stream)
+{
+	stream.Pod(dosv_timer);
+	stream.Pod(dosv_vtext_mode);
+	stream.Pod(dosv_fep_ctrl);
+	stream.Pod(dosv_vtext_deferred);
+	if(stream.loading) {
+		// the cursor comes back on the next timer tick
+		VGA_ClearCursorOverlay();
+		dosv_cursor_stat = 0;
+		DOSV_MarkTextDirty();
+	}
 }
 
 void DOSV_Setup()
 {
+	SAVESTATE_Register("dosv", &DOSV_SaveState);
 	SetTextSeg();
 	for(Bitu ct = 0 ; ct < DOSV_FONT_MAX ; ct++) {
 		dosv_font_handler[ct] = CALLBACK_Allocate();
@@ -31,6 +31,8 @@
 #include "timer.h"
 #include "j3.h"
 #include "jfont.h"
+#include "vga.h"
+#include "savestate.h"
 
 #define CHANGE_IM_POSITION_TIME		100
 
@@ -361,10 +363,24 @@ public:
 };
 KanjiRomPageHandler kanji_rom_handler;
 
+static void J3_SaveState(SaveStream & stream)
+{
+	stream.Pod(j3_timer);
+	stream.Pod(j3_text_color);
+	stream.Pod(j3_back_color);
+	if(stream.loading) {
+		// the cursor comes back on the next timer tick
+		VGA_ClearCursorOverlay();
+		j3_cursor_stat = 0;
+	}
+}
+
 void INT60_J3_Setup()
 {
 	Bitu code;
 
+	SAVESTATE_Register("j3", &J3_SaveState);
+
 	SetTextSeg();
 
 	PhysPt fontdata = Real2Phys(int10.rom.font_16);
@@ -388,34 +404,21 @@ void INT60_J3_Setup()
 	MEM_SetPageHandler(KANJI_ROM_PAGE, 16, &kanji_rom_handler);
 }
 
-static void J3_CursorXor(Bitu x, Bitu y)
+// The cursor is composited by the renderer, video memory is left alone
+static void J3_DrawCursor(Bitu x, Bitu y)
 {
 	Bitu end = real_readb(BIOSMEM_SEG, BIOSMEM_CURSOR_TYPE);
 	Bitu start = real_readb(BIOSMEM_SEG, BIOSMEM_CURSOR_TYPE + 1);
-	Bitu off;
 
 	if(start != 0x20 && start <= end) {
-		y += start;
-		off = (y >> 2) * 80 + 8 * 1024 * (y & 3) + x;
-		while(start <= end) {
-			real_writeb(GRAPH_J3_SEG, off, real_readb(GRAPH_J3_SEG, off) ^ 0xff);
-			if(j3_cursor_stat == 2) {
-				real_writeb(GRAPH_J3_SEG, off + 1, real_readb(GRAPH_J3_SEG, off + 1) ^ 0xff);
-			}
-			off += 0x2000;
-			if(off >= 0x8000) {
-				off -= 0x8000;
-				off += 80;
-			}
-			start++;
-		}
+		VGA_SetCursorOverlay(x * 8, (j3_cursor_stat == 2) ? 16 : 8, y + start, end - start + 1);
 	}
 }
 
 void J3_OffCursor()
 {
 	if(j3_cursor_stat) {
-		J3_CursorXor(j3_cursor_x, j3_cursor_y);
+		VGA_ClearCursorOverlay();
 		j3_cursor_stat = 0;
 	}
 }
@@ -469,9 +472,9 @@ void INT8_J3()
 				}
 				j3_cursor_x = x;
 				j3_cursor_y = y;
-				J3_CursorXor(x, y);
+				J3_DrawCursor(x, y);
 			} else {
-				J3_CursorXor(x, y);
+				VGA_ClearCursorOverlay();
 				j3_cursor_stat = 0;
 			}
 		}
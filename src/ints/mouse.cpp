@@ -35,6 +35,7 @@
 #include "bios.h"
 #include "dos_inc.h"
 #include "jfont.h"
+#include "savestate.h"
 
 static Bitu call_int33,call_int74,int74_ret_callback,call_mouse_bd;
 static Bit16u ps2cbseg,ps2cbofs;
@@ -1236,6 +1237,22 @@ Bitu MOUSE_UserInt_CB_Handler(void) {
 	return CBRET_NONE;
 }
 
+static void MOUSE_SaveState(SaveStream & stream) {
+	Bit8u userdef=(mouse.screenMask==userdefScreenMask);
+	stream.Bytes(&mouse,sizeof(mouse));
+	stream.Pod(userdef);
+	stream.Pod(userdefScreenMask);
+	stream.Pod(userdefCursorMask);
+	stream.Pod(ps2cbseg);
+	stream.Pod(ps2cbofs);
+	stream.Pod(useps2callback);
+	stream.Pod(ps2callbackinit);
+	if (stream.loading) {
+		mouse.screenMask=userdef ? userdefScreenMask : defaultScreenMask;
+		mouse.cursorMask=userdef ? userdefCursorMask : defaultCursorMask;
+	}
+}
+
 void MOUSE_Init(Section* /*sec*/) {
 	// Callback for mouse interrupt 0x33
 	call_int33=CALLBACK_Allocate();
@@ -1312,4 +1329,5 @@ void MOUSE_Init(Section* /*sec*/) {
 	Mouse_ResetHardware();
 	Mouse_Reset();
 	Mouse_SetSensitivity(50,50,50);
+	SAVESTATE_Register("mouse",&MOUSE_SaveState);
 }
@@ -29,6 +29,7 @@
 #include "inout.h"
 #include "xms.h"
 #include "bios.h"
+#include "savestate.h"
 
 #define XMS_HANDLES							50		/* 50 XMS Memory Blocks */ 
 #define XMS_VERSION    						0x0300	/* version 3.00 */
@@ -495,6 +496,10 @@ public:
 };
 static XMS* test;
 
+static void XMS_SaveState(SaveStream & stream) {
+	stream.Pod(xms_handles);
+}
+
 void XMS_ShutDown(Section* /*sec*/) {
 	delete test;	
 }
@@ -502,4 +507,5 @@ void XMS_ShutDown(Section* /*sec*/) {
 void XMS_Init(Section* sec) {
 	test = new XMS(sec);
 	sec->AddDestroyFunction(&XMS_ShutDown,true);
+	SAVESTATE_Register("xms",&XMS_SaveState);
 }
@@ -24,6 +24,11 @@
 
 #include "zmbv.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ZMBV_SSE2
+#endif
+
 #define DBZV_VERSION_HIGH 0
 #define DBZV_VERSION_LOW 1
 
@@ -87,6 +92,7 @@ bool VideoCodec::SetupBuffers(zmbv_format_t _format, int blockwidth, int blockhe
 	buf1 = new unsigned char[bufsize];
 	buf2 = new unsigned char[bufsize];
 	work = new unsigned char[bufsize];
+	work2 = new unsigned char[bufsize];
 
 	int xblocks = (width/blockwidth);
 	int xleft = width % blockwidth;
@@ -95,9 +101,11 @@ bool VideoCodec::SetupBuffers(zmbv_format_t _format, int blockwidth, int blockhe
 	int yleft = height % blockheight;
 	if (yleft) yblocks++;
 	blockcount=yblocks*xblocks;
+	blockrows=yblocks;
+	blockcols=xblocks;
 	blocks=new FrameBlock[blockcount];
 
-	if (!buf1 || !buf2 || !work || !blocks) {
+	if (!buf1 || !buf2 || !work || !work2 || !blocks) {
 		FreeBuffers();
 		return false;
 	}
@@ -117,6 +125,10 @@ bool VideoCodec::SetupBuffers(zmbv_format_t _format, int blockwidth, int blockhe
 			} else {
 				blocks[i].dy=blockheight;
 			}
+			blocks[i].vx=0;
+			blocks[i].vy=0;
+			blocks[i].change=0;
+			blocks[i].searched=false;
 			i++;
 		}
 	}
@@ -124,6 +136,7 @@ bool VideoCodec::SetupBuffers(zmbv_format_t _format, int blockwidth, int blockhe
 	memset(buf1,0,bufsize);
 	memset(buf2,0,bufsize);
 	memset(work,0,bufsize);
+	memset(work2,0,bufsize);
 	oldframe=buf1;
 	newframe=buf2;
 	format = _format;
@@ -146,16 +159,68 @@ void VideoCodec::CreateVectorTable(void) {
 	}
 }
 
+#if defined(ZMBV_SSE2)
+static INLINE int BitCount(unsigned int v) {
+	v = v - ((v >> 1) & 0x55555555);
+	v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+	return (((v + (v >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+}
+
+/* Byte mask of the pixels that differ in 16 bytes, 32bpp ignores the top byte like the scalar test */
+template<class P>
+static INLINE unsigned int DiffMask(const P * pold, const P * pnew) {
+	__m128i o = _mm_loadu_si128((const __m128i *)pold);
+	__m128i n = _mm_loadu_si128((const __m128i *)pnew);
+	__m128i eq;
+	switch (sizeof(P)) {
+	case 1:
+		eq = _mm_cmpeq_epi8(o, n);
+		break;
+	case 2:
+		eq = _mm_cmpeq_epi16(o, n);
+		break;
+	default: {
+		const __m128i rgb = _mm_set1_epi32(0x00ffffff);
+		eq = _mm_cmpeq_epi32(_mm_and_si128(o, rgb), _mm_and_si128(n, rgb));
+		break;
+		}
+	}
+	return ~(unsigned int)_mm_movemask_epi8(eq) & 0xffff;
+}
+#endif
+
+/* Count the pixels of a row that differ, looking only at every step'th pixel */
+template<class P>
+static INLINE int CompareRow(const P * pold, const P * pnew, int count, int step) {
+	int ret=0;
+	int x=0;
+#if defined(ZMBV_SSE2)
+	if (sizeof(P) <= 4) {
+		/* Pick the first byte of every sampled pixel in the movemask */
+		static const unsigned int pick[2][4] = {
+			{ 0xffff, 0x5555, 0, 0x1111 },
+			{ 0x1111, 0x0101, 0, 0x0001 },
+		};
+		const unsigned int mask = pick[step == 4][sizeof(P) - 1];
+		const int chunk = 16 / sizeof(P);
+		for (; x + chunk <= count; x += chunk)
+			ret += BitCount(DiffMask<P>(pold + x, pnew + x) & mask);
+	}
+#endif
+	for (; x<count; x+=step) {
+		int test=0-((pold[x]-pnew[x])&0x00ffffff);
+		ret-=(test>>31);
+	}
+	return ret;
+}
+
 template<class P>
 INLINE int VideoCodec::PossibleBlock(int vx,int vy,FrameBlock * block) {
 	int ret=0;
 	P * pold=((P*)oldframe)+block->start+(vy*pitch)+vx;
 	P * pnew=((P*)newframe)+block->start;;	
 	for (int y=0;y<block->dy;y+=4) {
-		for (int x=0;x<block->dx;x+=4) {
-			int test=0-((pold[x]-pnew[x])&0x00ffffff);
-			ret-=(test>>31);
-		}
+		ret+=CompareRow<P>(pold, pnew, block->dx, 4);
 		pold+=pitch*4;
 		pnew+=pitch*4;
 	}
@@ -168,10 +233,7 @@ INLINE int VideoCodec::CompareBlock(int vx,int vy,FrameBlock * block) {
 	P * pold=((P*)oldframe)+block->start+(vy*pitch)+vx;
 	P * pnew=((P*)newframe)+block->start;;	
 	for (int y=0;y<block->dy;y++) {
-		for (int x=0;x<block->dx;x++) {
-			int test=0-((pold[x]-pnew[x])&0x00ffffff);
-			ret-=(test>>31);
-		}
+		ret+=CompareRow<P>(pold, pnew, block->dx, 1);
 		pold+=pitch;
 		pnew+=pitch;
 	}
@@ -183,7 +245,16 @@ INLINE void VideoCodec::AddXorBlock(int vx,int vy,FrameBlock * block) {
 	P * pold=((P*)oldframe)+block->start+(vy*pitch)+vx;
 	P * pnew=((P*)newframe)+block->start;
 	for (int y=0;y<block->dy;y++) {
-		for (int x=0;x<block->dx;x++) {
+		int x=0;
+#if defined(ZMBV_SSE2)
+		for (;(x + (int)(16/sizeof(P))) <= block->dx;x+=16/sizeof(P)) {
+			__m128i o = _mm_loadu_si128((const __m128i *)(pold + x));
+			__m128i n = _mm_loadu_si128((const __m128i *)(pnew + x));
+			_mm_storeu_si128((__m128i *)&work[workUsed], _mm_xor_si128(n, o));
+			workUsed+=16;
+		}
+#endif
+		for (;x<block->dx;x++) {
 			*((P*)&work[workUsed])=pnew[x] ^ pold[x];
 			workUsed+=sizeof(P);
 		}
@@ -192,41 +263,60 @@ INLINE void VideoCodec::AddXorBlock(int vx,int vy,FrameBlock * block) {
 	}
 }
 
+template<class P>
+void VideoCodec::SearchBlock(FrameBlock * block) {
+	int bestvx = 0;
+	int bestvy = 0;
+	int bestchange=CompareBlock<P>(0,0, block);
+	/* Motion tends to continue, so try the vector of the last frame before the table */
+	int lastvx = block->vx;
+	int lastvy = block->vy;
+	if (bestchange>=4 && (lastvx || lastvy)) {
+		int testchange=CompareBlock<P>(lastvx,lastvy, block);
+		if (testchange<bestchange) {
+			bestchange=testchange;
+			bestvx = lastvx;
+			bestvy = lastvy;
+		}
+	}
+	int possibles=64;
+	for (int v=0;v<VectorCount && possibles;v++) {
+		if (bestchange<4) break;
+		int vx = VectorTable[v].x;
+		int vy = VectorTable[v].y;
+		if (vx == lastvx && vy == lastvy) continue;
+		if (PossibleBlock<P>(vx, vy, block) < 4) {
+			possibles--;
+//			if (!possibles) Msg("Ran out of possibles, at %d of %d best %d\n",v,VectorCount,bestchange);
+			int testchange=CompareBlock<P>(vx,vy, block);
+			if (testchange<bestchange) {
+				bestchange=testchange;
+				bestvx = vx;
+				bestvy = vy;
+			}
+		}
+	}
+	block->vx = bestvx;
+	block->vy = bestvy;
+	block->change = bestchange;
+	block->searched = true;
+}
+
 template<class P>
 void VideoCodec::AddXorFrame(void) {
-	int written=0;
-	int lastvector=0;
 	signed char * vectors=(signed char*)&work[workUsed];
 	/* Align the following xor data on 4 byte boundary*/
 	workUsed=(workUsed + blockcount*2 +3) & ~3;
-	int totalx=0;
-	int totaly=0;
 	for (int b=0;b<blockcount;b++) {
 		FrameBlock * block=&blocks[b];
-		int bestvx = 0;
-		int bestvy = 0;
-		int bestchange=CompareBlock<P>(0,0, block);
-		int possibles=64;
-		for (int v=0;v<VectorCount && possibles;v++) {
-			if (bestchange<4) break;
-			int vx = VectorTable[v].x;
-			int vy = VectorTable[v].y;
-			if (PossibleBlock<P>(vx, vy, block) < 4) {
-				possibles--;
-//				if (!possibles) Msg("Ran out of possibles, at %d of %d best %d\n",v,VectorCount,bestchange);
-				int testchange=CompareBlock<P>(vx,vy, block);
-				if (testchange<bestchange) {
-					bestchange=testchange;
-					bestvx = vx;
-					bestvy = vy;
-				}
-			}
-		}
-		vectors[b*2+0]=(bestvx << 1);
-		vectors[b*2+1]=(bestvy << 1);
-		if (bestchange) {
+		/* Blocks not handed out to SearchBlockRows are searched here */
+		if (!block->searched) SearchBlock<P>(block);
+		block->searched = false;
+		vectors[b*2+0]=(block->vx << 1);
+		vectors[b*2+1]=(block->vy << 1);
+		if (block->change) {
 			vectors[b*2+0]|=1;
-			AddXorBlock<P>(bestvx, bestvy, block);
+			AddXorBlock<P>(block->vx, block->vy, block);
 		}
 	}
 }
@@ -269,6 +359,7 @@ bool VideoCodec::PrepareCompressFrame(int flags,  zmbv_format_t _format, char *
 	compress.writeSize = writeSize;
 	compress.writeDone = 1;
 	compress.writeBuf = (unsigned char *)writeBuf;
+	compress.keyFrame = (flags & 1) != 0;
 	/* Set a pointer to the first byte which will contain info about this frame */
 	firstByte = compress.writeBuf;
 	*firstByte = 0;
@@ -298,8 +389,6 @@ bool VideoCodec::PrepareCompressFrame(int flags,  zmbv_format_t _format, char *
 				work[workUsed++] = palette[i*4+2];
 			}
 		}
-		/* Restart deflate */
-		deflateReset(&zstream);
 	} else {
 		if (palsize && pal && memcmp(pal, palette, palsize * 4)) {
 			*firstByte |= Mask_DeltaPalette;
@@ -326,9 +415,37 @@ void VideoCodec::CompressLines(int lineCount, void *lineData[]) {
 	}
 }
 
+int VideoCodec::BlockRows( void ) {
+	return blockrows;
+}
+
+/* Motion search only reads the frames, so disjoint block rows can be searched in parallel */
+void VideoCodec::SearchBlockRows( int first, int count ) {
+	if (compress.keyFrame) return;
+	if (first + count > blockrows) count = blockrows - first;
+	for (int b=first*blockcols;b<(first+count)*blockcols;b++) {
+		switch (format) {
+		case ZMBV_FORMAT_8BPP:
+			SearchBlock<char>(&blocks[b]);
+			break;
+		case ZMBV_FORMAT_15BPP:
+		case ZMBV_FORMAT_16BPP:
+			SearchBlock<short>(&blocks[b]);
+			break;
+		case ZMBV_FORMAT_32BPP:
+			SearchBlock<unsigned int>(&blocks[b]);
+			break;
+		}
+	}
+}
+
 int VideoCodec::FinishCompressFrame( void ) {
-	unsigned char firstByte = *compress.writeBuf;
-	if (firstByte & Mask_KeyFrame) {
+	return DeflateFrame(EncodeFrame());
+}
+
+VideoCodec::FrameData VideoCodec::EncodeFrame( void ) {
+	FrameData frame;
+	if (compress.keyFrame) {
 		int i;
 		/* Add the full frame data */
 		unsigned char * readFrame = newframe + pixelsize*(MAX_VECTOR+MAX_VECTOR*pitch);	
@@ -348,20 +465,37 @@ int VideoCodec::FinishCompressFrame( void ) {
 			AddXorFrame<short>();
 			break;
 		case ZMBV_FORMAT_32BPP:
-			AddXorFrame<long>();
+			AddXorFrame<unsigned int>();
 			break;
 		}
 	}
+	frame.work = work;
+	frame.workUsed = workUsed;
+	frame.writeBuf = compress.writeBuf;
+	frame.writeSize = compress.writeSize;
+	frame.writeDone = compress.writeDone;
+	/* The next frame is built in the other buffer */
+	work = work2;
+	work2 = frame.work;
+	return frame;
+}
+
+/* Frames have to be deflated in the order they were encoded */
+int VideoCodec::DeflateFrame( const FrameData &frame ) {
+	if (*frame.writeBuf & Mask_KeyFrame) {
+		/* Restart deflate */
+		deflateReset(&zstream);
+	}
 	/* Create the actual frame with compression */
-	zstream.next_in = (Bytef *)work;
-	zstream.avail_in = workUsed;
+	zstream.next_in = (Bytef *)frame.work;
+	zstream.avail_in = frame.workUsed;
 	zstream.total_in = 0;
 
-	zstream.next_out = (Bytef *)(compress.writeBuf + compress.writeDone);
-	zstream.avail_out = compress.writeSize - compress.writeDone;
+	zstream.next_out = (Bytef *)(frame.writeBuf + frame.writeDone);
+	zstream.avail_out = frame.writeSize - frame.writeDone;
 	zstream.total_out = 0;
 	int res = deflate(&zstream, Z_SYNC_FLUSH);
-	return compress.writeDone + zstream.total_out;
+	return frame.writeDone + zstream.total_out;
 }
 
 template<class P>
@@ -469,7 +603,7 @@ bool VideoCodec::DecompressFrame(void * framedata, int size) {
 			UnXorFrame<short>();
 			break;
 		case ZMBV_FORMAT_32BPP:
-			UnXorFrame<long>();
+			UnXorFrame<unsigned int>();
 			break;
 		}
 	}
@@ -536,6 +670,9 @@ void VideoCodec::FreeBuffers(void) {
 	if (work) {
 		delete[] work;work=0;
 	}
+	if (work2) {
+		delete[] work2;work2=0;
+	}
 }
 
 
@@ -545,5 +682,6 @@ VideoCodec::VideoCodec() {
 	buf1 = 0;
 	buf2 = 0;
 	work = 0;
+	work2 = 0;
 	memset( &zstream, 0, sizeof(zstream));
 }
@@ -44,6 +44,10 @@ private:
 	struct FrameBlock {
 		int start;
 		int dx,dy;
+		/* Motion search result for the current frame */
+		int vx,vy;
+		int change;
+		bool searched;
 	};
 	struct CodecVector {
 		int x,y;
@@ -62,6 +66,7 @@ private:
 		int		writeSize;
 		int		writeDone;
 		unsigned char	*writeBuf;
+		bool	keyFrame;
 	} compress;
 
 	CodecVector VectorTable[512];
@@ -69,9 +74,12 @@ private:
 
 	unsigned char *oldframe, *newframe;
 	unsigned char *buf1, *buf2, *work;
+	/* Frames are built in one work buffer while the other one is deflated */
+	unsigned char *work2;
 	int bufsize;
 
 	int blockcount; 
+	int blockrows, blockcols;
 	FrameBlock * blocks;
 
 	int workUsed, workPos;
@@ -89,6 +97,8 @@ private:
 	void CreateVectorTable(void);
 	bool SetupBuffers(zmbv_format_t format, int blockwidth, int blockheight);
 
+	template<class P>
+		void SearchBlock(FrameBlock * block);
 	template<class P>
 		void AddXorFrame(void);
 	template<class P>
@@ -104,6 +114,15 @@ private:
 	template<class P>
 		INLINE void CopyBlock(int vx, int vy,FrameBlock * block);
 public:
+	/* A built frame waiting for deflate */
+	struct FrameData {
+		unsigned char	*work;
+		int		workUsed;
+		unsigned char	*writeBuf;
+		int		writeSize;
+		int		writeDone;
+	};
+
 	VideoCodec();
 	bool SetupCompress( int _width, int _height);
 	bool SetupDecompress( int _width, int _height);
@@ -112,7 +131,12 @@ public:
 
 	void CompressLines(int lineCount, void *lineData[]);
 	bool PrepareCompressFrame(int flags,  zmbv_format_t _format, char * pal, void *writeBuf, int writeSize);
-	int FinishCompressFrame( void );
+	int FinishCompressFrame( void );
+	/* FinishCompressFrame split in stages that can run on different threads */
+	int BlockRows( void );
+	void SearchBlockRows( int first, int count );
+	FrameData EncodeFrame( void );
+	int DeflateFrame( const FrameData &frame );
 	bool DecompressFrame(void * framedata, int size);
 	void Output_UpsideDown_24(void * output);
 };
@@ -25,14 +25,27 @@
 #include "jfont.h"
 #include "../ints/int10.h"
 #include "SDL_events.h"
+#include "SDL_thread.h"
+#include "savestate.h"
 #if defined(LINUX)
 #include <X11/Xlib.h>
 #include <X11/Xlocale.h>
 #include <X11/Xutil.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #endif
 
 #define	GAIJI_MAX		100
 
+// DBCS glyph cache file
+#define	FONT_CACHE_ID			"JFCACHE"
+#define	FONT_CACHE_VERSION		1
+#define	FONT_CACHE_NAME_LEN		48
+#define	FONT_CACHE_HEADER_LEN	64
+#define	FONT_CACHE_RECORD_LEN	76
+
 extern Bit8u jfont_sbcs_19[];
 extern Bit8u jfont_dbcs_16[];
 extern Bit8u jfont_sbcs_16[];
@@ -43,8 +56,6 @@ extern Bit8u jfont_cache_dbcs_24[];
 
 static Bit16u jtext_seg;
 #if defined(WIN32)
-static HFONT jfont_16;
-static HFONT jfont_24;
 static bool usefont20_flag;
 #endif
 static std::string jfont_name;
@@ -52,6 +63,8 @@ static Bit8u jfont_dbcs[96];
 static Bitu gaiji_start;
 static Bitu gaiji_end;
 static Bit16u gaiji_seg;
+static Bit8u gaiji_font16[GAIJI_MAX * 32];
+static FILE *font_cache_file;
 
 static Bit8u dosv_font19_data[] = 
 {
@@ -268,79 +281,85 @@ static Bit8u frame_font24_data[] =
 	0x00,0x18,0x00,0x00,0x18,0x00,0x00,0x18,0x00,0x00,0x18,0x00,0x00,0x18,0x00,0x00,0x18,0x00,0x00,0x18,0x00,0x00,0x18,0x00,0x00,0x18,0x00,0x00,0x18,0x00,0x00,0x18,0x00,0xff,0xff,0xff,0x00,0x18,0x00,0x00,0x18,0x00,0x00,0x18,0x00,0x00,0x18,0x00,0x00,0x18,0x00,0x00,0x18,0x00,0x00,0x18,0x00,0x00,0x18,0x00,0x00,0x18,0x00,0x00,0x18,0x00,0x00,0x18,0x00,0x00,0x18,0x00,
 };
 
+// handles needed to rasterize characters; each thread uses its own
+struct FontContext {
 #if defined(LINUX)
-static Display *font_display;
-static Window font_window;
-static Pixmap font_pixmap;
-static GC font_gc;
-static XFontSet font_set16;
-static XFontSet font_set24;
+	Display *display;
+	Window window;
+	Pixmap pixmap;
+	GC gc;
+	XFontSet set16;
+	XFontSet set24;
+#endif
+#if defined(WIN32)
+	HFONT font16;
+	HFONT font24;
 #endif
+};
 
-void QuitFont()
+static FontContext font_context;
+
+static void CloseFontContext(FontContext *ctx)
 {
 #if defined(LINUX)
-	if(font_display) {
-		if(font_gc) {
-			XFreeGC(font_display, font_gc);
+	if(ctx->display) {
+		if(ctx->gc) {
+			XFreeGC(ctx->display, ctx->gc);
 		}
-		if(font_pixmap) {
-			XFreePixmap(font_display, font_pixmap);
+		if(ctx->pixmap) {
+			XFreePixmap(ctx->display, ctx->pixmap);
 		}
-		if(font_set16) {
-			XFreeFontSet(font_display, font_set16);
+		if(ctx->set16) {
+			XFreeFontSet(ctx->display, ctx->set16);
 		}
-		if(font_set24) {
-			XFreeFontSet(font_display, font_set24);
+		if(ctx->set24) {
+			XFreeFontSet(ctx->display, ctx->set24);
 		}
-		if(font_window) {
-			XDestroyWindow(font_display, font_window);
+		if(ctx->window) {
+			XDestroyWindow(ctx->display, ctx->window);
 		}
-		XCloseDisplay(font_display);
+		XCloseDisplay(ctx->display);
 	}
 #endif
 #if defined(WIN32)
-	if(jfont_16) {
-		DeleteObject(jfont_16);
+	if(ctx->font16) {
+		DeleteObject(ctx->font16);
 	}
-	if(jfont_24) {
-		DeleteObject(jfont_24);
+	if(ctx->font24) {
+		DeleteObject(ctx->font24);
 	}
 #endif
+	memset(ctx, 0, sizeof(FontContext));
 }
 
-void InitFontHandle()
+static void OpenFontContext(FontContext *ctx)
 {
 #if defined(LINUX)
 	int missing_count;
 	char **missing_list;
 	char *def_string;
 
-	if(!font_display) {
-		font_display = XOpenDisplay("");
+	if(!ctx->display) {
+		ctx->display = XOpenDisplay("");
 	}
-	if(font_display) {
-		if(!font_set16) {
-			font_set16 = XCreateFontSet(font_display, "-*-fixed-medium-r-normal--16-*-*-*", &missing_list, &missing_count, &def_string);
+	if(ctx->display) {
+		if(!ctx->set16) {
+			ctx->set16 = XCreateFontSet(ctx->display, "-*-fixed-medium-r-normal--16-*-*-*", &missing_list, &missing_count, &def_string);
 			XFreeStringList(missing_list);
 		}
-		if(!font_set24) {
-			font_set24 = XCreateFontSet(font_display, "-*-fixed-medium-r-normal--24-*-*-*", &missing_list, &missing_count, &def_string);
+		if(!ctx->set24) {
+			ctx->set24 = XCreateFontSet(ctx->display, "-*-fixed-medium-r-normal--24-*-*-*", &missing_list, &missing_count, &def_string);
 			XFreeStringList(missing_list);
 		}
-		if(!font_window) {
-			font_window = XCreateSimpleWindow(font_display, DefaultRootWindow(font_display), 0, 0, 32, 32, 0, BlackPixel(font_display, DefaultScreen(font_display)), WhitePixel(font_display, DefaultScreen(font_display)));
-			font_pixmap = XCreatePixmap(font_display, font_window, 32, 32, DefaultDepth(font_display, 0));
-			font_gc = XCreateGC(font_display, font_pixmap, 0, 0);
+		if(!ctx->window) {
+			ctx->window = XCreateSimpleWindow(ctx->display, DefaultRootWindow(ctx->display), 0, 0, 32, 32, 0, BlackPixel(ctx->display, DefaultScreen(ctx->display)), WhitePixel(ctx->display, DefaultScreen(ctx->display)));
+			ctx->pixmap = XCreatePixmap(ctx->display, ctx->window, 32, 32, DefaultDepth(ctx->display, 0));
+			ctx->gc = XCreateGC(ctx->display, ctx->pixmap, 0, 0);
 		}
 	}
 #endif
-#if defined(WIN32)	
-	if(jfont_name.empty()) {
-		// MS Gothic
-		SetFontName("\x082\x06c\x082\x072\x020\x083\x053\x083\x056\x083\x062\x083\x04e");
-	}
-	if(jfont_16 == NULL || jfont_24 == NULL) {
+#if defined(WIN32)
+	if(ctx->font16 == NULL || ctx->font24 == NULL) {
 		LOGFONT lf = { 0 };
 		lf.lfHeight = 16;
 		lf.lfCharSet = SHIFTJIS_CHARSET;
@@ -349,11 +368,31 @@ void InitFontHandle()
 		lf.lfQuality = DEFAULT_QUALITY;
 		lf.lfPitchAndFamily = FIXED_PITCH;
 		strcpy(lf.lfFaceName, jfont_name.c_str());
-		jfont_16 = CreateFontIndirect(&lf);
+		ctx->font16 = CreateFontIndirect(&lf);
 		lf.lfHeight = usefont20_flag ? 20 : 24;
-		jfont_24 = CreateFontIndirect(&lf);
+		ctx->font24 = CreateFontIndirect(&lf);
+	}
+#endif
+}
+
+void QuitFont()
+{
+	if(font_cache_file) {
+		fclose(font_cache_file);
+		font_cache_file = NULL;
+	}
+	CloseFontContext(&font_context);
+}
+
+void InitFontHandle()
+{
+#if defined(WIN32)
+	if(jfont_name.empty()) {
+		// MS Gothic
+		SetFontName("\x082\x06c\x082\x072\x020\x083\x053\x083\x056\x083\x062\x083\x04e");
 	}
 #endif
+	OpenFontContext(&font_context);
 }
 
 #if defined(LINUX)
@@ -422,7 +461,7 @@ bool CheckLinuxSymbol(Bitu code, Bit8u *buff, int width, int height)
 }
 #endif
 
-bool GetWindowsFont(Bitu code, Bit8u *buff, int width, int height)
+static bool GetContextFont(FontContext *ctx, Bitu code, Bit8u *buff, int width, int height)
 {
 #if defined(LINUX)
 	XRectangle ir, lr;
@@ -460,25 +499,25 @@ bool GetWindowsFont(Bitu code, Bit8u *buff, int width, int height)
 	memset(buff, 0, (width / 8) * height);
 
 	if(height == 24) {
-		if(font_set24 == NULL) {
+		if(ctx->set24 == NULL) {
 			return false;
 		}
-		XwcTextExtents(font_set24, text, 2, &ir, &lr);
+		XwcTextExtents(ctx->set24, text, 2, &ir, &lr);
 	} else {
-		if(font_set16 == NULL) {
+		if(ctx->set16 == NULL) {
 			return false;
 		}
-		XwcTextExtents(font_set16, text, 2, &ir, &lr);
+		XwcTextExtents(ctx->set16, text, 2, &ir, &lr);
 	}
-	XSetForeground(font_display, font_gc, BlackPixel(font_display, 0));
-	XFillRectangle(font_display, font_pixmap, font_gc, 0, 0, 32, 32);
-	XSetForeground(font_display, font_gc, WhitePixel(font_display, 0));
+	XSetForeground(ctx->display, ctx->gc, BlackPixel(ctx->display, 0));
+	XFillRectangle(ctx->display, ctx->pixmap, ctx->gc, 0, 0, 32, 32);
+	XSetForeground(ctx->display, ctx->gc, WhitePixel(ctx->display, 0));
 	if(height == 24) {
-		XwcDrawString(font_display, font_pixmap, font_set24, font_gc, 0, lr.height - (ir.height + ir.y), text, 2);
+		XwcDrawString(ctx->display, ctx->pixmap, ctx->set24, ctx->gc, 0, lr.height - (ir.height + ir.y), text, 2);
 	} else {
-		XwcDrawString(font_display, font_pixmap, font_set16, font_gc, 0, lr.height - (ir.height + ir.y), text, 2);
+		XwcDrawString(ctx->display, ctx->pixmap, ctx->set16, ctx->gc, 0, lr.height - (ir.height + ir.y), text, 2);
 	}
-	XImage *image = XGetImage(font_display, font_pixmap, 0, 0, width, lr.height, ~0, XYPixmap);
+	XImage *image = XGetImage(ctx->display, ctx->pixmap, 0, 0, width, lr.height, ~0, XYPixmap);
 	if(image != NULL) {
 		int x, y;
 		for(y = 0 ; y < height ; y++) {
@@ -513,7 +552,7 @@ bool GetWindowsFont(Bitu code, Bit8u *buff, int width, int height)
 	}
 #endif
 #if defined(WIN32)
-	HFONT font = (height == 16) ? jfont_16 : jfont_24;
+	HFONT font = (height == 16) ? ctx->font16 : ctx->font24;
 	if(font != NULL) {
 		HDC hdc = GetDC(NULL);
 		HFONT old_font = (HFONT)SelectObject(hdc, font);
@@ -574,6 +613,10 @@ bool GetWindowsFont(Bitu code, Bit8u *buff, int width, int height)
 	return false;
 }
 
+bool GetWindowsFont(Bitu code, Bit8u *buff, int width, int height)
+{
+	return GetContextFont(&font_context, code, buff, width, height);
+}
 
 Bit16u GetTextSeg()
 {
@@ -689,6 +732,129 @@ void SetFontName(const char *name)
 #endif
 }
 
+static void MakeFontCacheHeader(Bit8u *header)
+{
+	memset(header, 0, FONT_CACHE_HEADER_LEN);
+	memcpy(header, FONT_CACHE_ID, sizeof(FONT_CACHE_ID));
+	host_writed(&header[8], FONT_CACHE_VERSION);
+#if defined(WIN32)
+	header[12] = usefont20_flag ? 1 : 0;
+#endif
+	strncpy((char *)&header[16], jfont_name.c_str(), FONT_CACHE_NAME_LEN - 1);
+}
+
+// record : code(2) height(1) reserved(1) glyph(72)
+static void LoadFontCacheRecords(Bit8u *data, Bitu size)
+{
+	Bitu count = 0;
+	for(Bitu pos = FONT_CACHE_HEADER_LEN ; pos + FONT_CACHE_RECORD_LEN <= size ; pos += FONT_CACHE_RECORD_LEN) {
+		Bitu code = host_readw(&data[pos]);
+		Bit8u height = data[pos + 2];
+		if(height == 16) {
+			if(jfont_cache_dbcs_16[code] == 0) {
+				memcpy(&jfont_dbcs_16[code * 32], &data[pos + 4], 32);
+				jfont_cache_dbcs_16[code] = 1;
+				count++;
+			}
+		} else if(height == 24) {
+			if(jfont_cache_dbcs_24[code] == 0) {
+				memcpy(&jfont_dbcs_24[code * 72], &data[pos + 4], 72);
+				jfont_cache_dbcs_24[code] = 1;
+				count++;
+			}
+		}
+	}
+	LOG_MSG("MSG: %d glyphs loaded from font cache.", (int)count);
+}
+
+void OpenFontCache(const char *path)
+{
+	Bit8u header[FONT_CACHE_HEADER_LEN];
+	bool valid = false;
+
+	if(path == NULL || *path == '\0') {
+		return;
+	}
+	MakeFontCacheHeader(header);
+#if defined(LINUX)
+	int fd = open(path, O_RDONLY);
+	if(fd != -1) {
+		struct stat st;
+		if(fstat(fd, &st) == 0 && st.st_size >= FONT_CACHE_HEADER_LEN) {
+			void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(map != MAP_FAILED) {
+				madvise(map, st.st_size, MADV_SEQUENTIAL);
+				if(memcmp(map, header, FONT_CACHE_HEADER_LEN) == 0) {
+					LoadFontCacheRecords((Bit8u *)map, st.st_size);
+					valid = true;
+				}
+				munmap(map, st.st_size);
+			}
+		}
+		close(fd);
+	}
+#else
+	FILE *fp = fopen(path, "rb");
+	if(fp) {
+		fseek(fp, 0, SEEK_END);
+		long size = ftell(fp);
+		fseek(fp, 0, SEEK_SET);
+		if(size >= FONT_CACHE_HEADER_LEN) {
+			Bit8u *data = new Bit8u[size];
+			if(fread(data, 1, size, fp) == (size_t)size && memcmp(data, header, FONT_CACHE_HEADER_LEN) == 0) {
+				LoadFontCacheRecords(data, size);
+				valid = true;
+			}
+			delete [] data;
+		}
+		fclose(fp);
+	}
+#endif
+	if(valid) {
+		font_cache_file = fopen(path, "ab");
+	} else {
+		// missing, old version or different font : start a new cache
+		// other instances may have the old one mapped, so it is replaced instead of truncated
+		std::string temp = std::string(path) + ".tmp";
+		FILE *fp = fopen(temp.c_str(), "wb");
+		if(fp) {
+			bool written = fwrite(header, 1, FONT_CACHE_HEADER_LEN, fp) == FONT_CACHE_HEADER_LEN;
+			if(fclose(fp) != 0) {
+				written = false;
+			}
+#if defined(WIN32)
+			// rename does not replace an existing file here
+			if(written) {
+				remove(path);
+			}
+#endif
+			if(written && rename(temp.c_str(), path) == 0) {
+				font_cache_file = fopen(path, "ab");
+			} else {
+				remove(temp.c_str());
+			}
+		}
+	}
+	if(font_cache_file) {
+		// one write per record, so that instances sharing the file do not interleave
+		setvbuf(font_cache_file, NULL, _IONBF, 0);
+	} else {
+		LOG_MSG("MSG: Can't open font cache file: %s", path);
+	}
+}
+
+static void AppendFontCache(Bitu code, Bit8u height, Bit8u *data)
+{
+	if(font_cache_file && (code < gaiji_start || code > gaiji_end) && (code < 0x849f || code > 0x84be)) {
+		Bit8u record[FONT_CACHE_RECORD_LEN];
+		memset(record, 0, sizeof(record));
+		host_writew(&record[0], (Bit16u)code);
+		record[2] = height;
+		memcpy(&record[4], data, (height == 16) ? 32 : 72);
+		fwrite(record, 1, FONT_CACHE_RECORD_LEN, font_cache_file);
+	}
+}
+
 void GetDbcsFrameFont(Bitu code, Bit8u *buff)
 {
 	if(code >= 0x849f && code <= 0x84be) {
@@ -703,72 +869,185 @@ void GetDbcs24FrameFont(Bitu code, Bit8u *buff)
 	}
 }
 
-Bit8u *GetDbcsFont(Bitu code)
+// buff : work area of at least 72 bytes
+static bool MakeDbcsFont(FontContext *ctx, Bitu code, Bit8u *buff)
 {
-	memset(jfont_dbcs, 0, sizeof(jfont_dbcs));
-	if(code >= gaiji_start && code <= gaiji_end) {
-		Bitu count;
-		code = (code - gaiji_start) * 32;
-		for(count = 0 ; count < 32 ; count++) {
-			jfont_dbcs[count] = real_readb(gaiji_seg, code + count);
+	memset(buff, 0, 72);
+	if(code >= 0x849f && code <= 0x84be) {
+		GetDbcsFrameFont(code, buff);
+	} else if(!GetContextFont(ctx, code, buff, 16, 16)) {
+		return false;
+	}
+	memcpy(&jfont_dbcs_16[code * 32], buff, 32);
+	jfont_cache_dbcs_16[code] = 1;
+	return true;
+}
+
+static bool MakeDbcs24Font(FontContext *ctx, Bitu code, Bit8u *buff)
+{
+	memset(buff, 0, 72);
+	if((code >= 0x809e && code < 0x80fe) || (code >= 0x8540 && code <= 0x857e)) {
+		// half width characters in 24x24 cell
+		Bitu sbcs = (code < 0x8100) ? code - 0x807e : code - 0x8540 + 0xa1;
+		if(!GetContextFont(ctx, sbcs, buff, 12, 24)) {
+			return false;
+		}
+		Bitu no, pos;
+		pos = code * 72;
+		for(no = 0 ; no < 24 ; no++) {
+			jfont_dbcs_24[pos + no * 3] = buff[no * 2];
+			jfont_dbcs_24[pos + no * 3 + 1] = buff[no * 2 + 1] | (buff[no * 2] >> 4);
+			jfont_dbcs_24[pos + no * 3 + 2] = (buff[no * 2] << 4) | (buff[no * 2 + 1] >> 4);
 		}
-		return jfont_dbcs;
+	} else {
+		if(code >= 0x849f && code <= 0x84be) {
+			GetDbcs24FrameFont(code, buff);
+		} else if(!GetContextFont(ctx, code, buff, 24, 24)) {
+			return false;
+		}
+		memcpy(&jfont_dbcs_24[code * 72], buff, 72);
+	}
+	jfont_cache_dbcs_24[code] = 1;
+	return true;
+}
+
+// The returned pointer stays valid; characters that can not be rasterized
+// keep their all zero entry in jfont_dbcs_16/24.
+const Bit8u *GetDbcsGlyph(Bitu code)
+{
+	if(code >= gaiji_start && code <= gaiji_end) {
+		// the guest may write the table directly, so the glyph is read each time
+		code -= gaiji_start;
+		MEM_BlockRead(PhysMake(gaiji_seg, code * 32), &gaiji_font16[code * 32], 32);
+		return &gaiji_font16[code * 32];
 	}
 	if(jfont_cache_dbcs_16[code] == 0) {
-		if(code >= 0x849f && code <= 0x84be) {
-			GetDbcsFrameFont(code, jfont_dbcs);
-			memcpy(&jfont_dbcs_16[code * 32], jfont_dbcs, 32);
-			jfont_cache_dbcs_16[code] = 1;
-		} else if(GetWindowsFont(code, jfont_dbcs, 16, 16)) {
-			memcpy(&jfont_dbcs_16[code * 32], jfont_dbcs, 32);
-			jfont_cache_dbcs_16[code] = 1;
+		if(MakeDbcsFont(&font_context, code, jfont_dbcs)) {
+			AppendFontCache(code, 16, &jfont_dbcs_16[code * 32]);
 		}
-		return jfont_dbcs;
 	}
 	return &jfont_dbcs_16[code * 32];
 }
 
-Bit8u *GetDbcs24Font(Bitu code)
+const Bit8u *GetDbcs24Glyph(Bitu code)
 {
-	memset(jfont_dbcs, 0, sizeof(jfont_dbcs));
 	if(jfont_cache_dbcs_24[code] == 0) {
-		if(code >= 0x809e && code < 0x80fe) {
-			if(GetWindowsFont(code - 0x807e, jfont_dbcs, 12, 24)) {
-				Bitu no, pos;
-				pos = code * 72;
-				for(no = 0 ; no < 24 ; no++) {
-					jfont_dbcs_24[pos + no * 3] = jfont_dbcs[no * 2];
-					jfont_dbcs_24[pos + no * 3 + 1] = jfont_dbcs[no * 2 + 1] | (jfont_dbcs[no * 2] >> 4);
-					jfont_dbcs_24[pos + no * 3 + 2] = (jfont_dbcs[no * 2] << 4) | (jfont_dbcs[no * 2 + 1] >> 4);
-				}
-				jfont_cache_dbcs_24[code] = 1;
-				return &jfont_dbcs_24[pos];
+		if(MakeDbcs24Font(&font_context, code, jfont_dbcs)) {
+			AppendFontCache(code, 24, &jfont_dbcs_24[code * 72]);
+		}
+	}
+	return &jfont_dbcs_24[code * 72];
+}
+
+Bit8u *GetDbcsFont(Bitu code)
+{
+	return (Bit8u *)GetDbcsGlyph(code);
+}
+
+Bit8u *GetDbcs24Font(Bitu code)
+{
+	return (Bit8u *)GetDbcs24Glyph(code);
+}
+
+// rasterize all DBCS characters at startup
+static SDL_mutex *prerender_mutex;
+static Bitu prerender_lead;
+static bool prerender_24;
+
+static int PrerenderFontThread(void *data)
+{
+	FontContext *ctx = (FontContext *)data;
+	Bit8u buff[96];
+	for(;;) {
+		SDL_mutexP(prerender_mutex);
+		Bitu lead = prerender_lead++;
+		SDL_mutexV(prerender_mutex);
+		// 0x80 : half width 24x24, 0xf0-0xfc : user defined area
+		if(lead >= 0xf0) {
+			break;
+		}
+		if(lead != 0x80 && !isKanji1(lead)) {
+			continue;
+		}
+		for(Bitu trail = 0x40 ; trail <= 0xfc ; trail++) {
+			Bitu code = (lead << 8) | trail;
+			if(lead != 0x80 && isKanji2(trail) && jfont_cache_dbcs_16[code] == 0) {
+				MakeDbcsFont(ctx, code, buff);
 			}
-		} else if(code >= 0x8540 && code <= 0x857e) {
-			if(GetWindowsFont(code - 0x8540 + 0xa1, jfont_dbcs, 12, 24)) {
-				Bitu no, pos;
-				pos = code * 72;
-				for(no = 0 ; no < 24 ; no++) {
-					jfont_dbcs_24[pos + no * 3] = jfont_dbcs[no * 2];
-					jfont_dbcs_24[pos + no * 3 + 1] = jfont_dbcs[no * 2 + 1] | (jfont_dbcs[no * 2] >> 4);
-					jfont_dbcs_24[pos + no * 3 + 2] = (jfont_dbcs[no * 2] << 4) | (jfont_dbcs[no * 2 + 1] >> 4);
+			if(prerender_24 && jfont_cache_dbcs_24[code] == 0) {
+				if(lead != 0x80 ? isKanji2(trail) : (code >= 0x809e && code < 0x80fe)) {
+					MakeDbcs24Font(ctx, code, buff);
 				}
-				jfont_cache_dbcs_24[code] = 1;
-				return &jfont_dbcs_24[pos];
 			}
-		} else if(code >= 0x849f && code <= 0x84be) {
-			GetDbcs24FrameFont(code, jfont_dbcs);
-			memcpy(&jfont_dbcs_24[code * 72], jfont_dbcs, 72);
-			jfont_cache_dbcs_24[code] = 1;
+		}
+	}
+	return 0;
+}
+
+// The prerender threads draw with Xlib in parallel. Xlib has to be told
+// before its first call, which SDL makes when it opens the display.
+void JFONT_InitThreads()
+{
+#if defined(LINUX)
+	XInitThreads();
+#endif
+}
+
+void PrerenderDbcsFont(Bitu threads)
+{
+	FontContext *ctx;
+	SDL_Thread **thread;
+	Bit8u *done_16, *done_24;
+	Bitu no, count, start;
+
+	if(threads == 0) {
+		return;
+	}
+	InitFontHandle();
+	start = SDL_GetTicks();
+	done_16 = new Bit8u[65536];
+	done_24 = new Bit8u[65536];
+	memcpy(done_16, jfont_cache_dbcs_16, 65536);
+	memcpy(done_24, jfont_cache_dbcs_24, 65536);
+
+	// font handles are created here, threads only draw with them
+	ctx = new FontContext[threads];
+	thread = new SDL_Thread *[threads];
+	memset(ctx, 0, sizeof(FontContext) * threads);
+	prerender_mutex = SDL_CreateMutex();
+	prerender_lead = 0x80;
+	prerender_24 = IS_J3_ARCH || IS_DOSV;
+	for(no = 0 ; no < threads ; no++) {
+		OpenFontContext(&ctx[no]);
+		thread[no] = SDL_CreateThread(PrerenderFontThread, &ctx[no]);
+	}
+	for(no = 0 ; no < threads ; no++) {
+		if(thread[no]) {
+			SDL_WaitThread(thread[no], NULL);
 		} else {
-			if(GetWindowsFont(code, jfont_dbcs, 24, 24)) {
-				memcpy(&jfont_dbcs_24[code * 72], jfont_dbcs, 72);
-				jfont_cache_dbcs_24[code] = 1;
-			}
+			PrerenderFontThread(&ctx[no]);
 		}
-		return jfont_dbcs;
+		CloseFontContext(&ctx[no]);
 	}
-	return &jfont_dbcs_24[code * 72];
+	SDL_DestroyMutex(prerender_mutex);
+	prerender_mutex = NULL;
+	delete [] thread;
+	delete [] ctx;
+
+	count = 0;
+	for(Bitu code = 0 ; code < 65536 ; code++) {
+		if(done_16[code] == 0 && jfont_cache_dbcs_16[code] != 0) {
+			AppendFontCache(code, 16, &jfont_dbcs_16[code * 32]);
+			count++;
+		}
+		if(done_24[code] == 0 && jfont_cache_dbcs_24[code] != 0) {
+			AppendFontCache(code, 24, &jfont_dbcs_24[code * 72]);
+			count++;
+		}
+	}
+	delete [] done_16;
+	delete [] done_24;
+	LOG_MSG("MSG: %d DBCS characters rasterized in %d ms.", (int)count, (int)(SDL_GetTicks() - start));
 }
 
 bool CheckStayVz()
@@ -839,6 +1118,23 @@ Bit16u GetGaijiSeg()
 	return gaiji_seg;
 }
 
+// The 16 dot gaiji live in guest memory, the 24 dot ones only in jfont_dbcs_24
+static void GAIJI_SaveState(SaveStream & stream)
+{
+	Bitu start = gaiji_start;
+	Bitu end = gaiji_end;
+	stream.Pod(start);
+	stream.Pod(end);
+	if(stream.loading && (start != gaiji_start || end != gaiji_end)) {
+		stream.failed = true;
+		return;
+	}
+	for(Bitu code = gaiji_start ; code <= gaiji_end ; code++) {
+		stream.Pod(jfont_cache_dbcs_24[code]);
+		stream.Bytes(&jfont_dbcs_24[code * 72], 72);
+	}
+}
+
 void SetGaijiConfig(Section_prop *section)
 {
 	Bitu count;
@@ -852,6 +1148,7 @@ void SetGaijiConfig(Section_prop *section)
 		gaiji_end = gaiji_start + GAIJI_MAX - 1;
 	}
 	gaiji_seg = DOS_GetMemory(count * 2);
+	SAVESTATE_Register("gaiji", &GAIJI_SaveState);
 }
 
 #ifndef NDEBUG
@@ -254,5 +254,10 @@ void JFONT_Init(Section_prop * section) {
 			}
 		}
 	}
+	pathprop = section->Get_path("jfontcache");
+	if(pathprop) {
+		OpenFontCache(pathprop->realpath.c_str());
+	}
+	PrerenderDbcsFont(section->Get_int("jfontprerender"));
 }
 
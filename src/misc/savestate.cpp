@@ -0,0 +1,255 @@
+/*
+ *  Copyright (C) 2002-2015  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "dosbox.h"
+#include "savestate.h"
+#include "mem.h"
+#include "cpu.h"
+#include "pic.h"
+#include "vga.h"
+#include "setup.h"
+#include "mapper.h"
+
+#define SAVESTATE_ID		"DBXSTATE"
+#define SAVESTATE_VERSION	1
+#define SAVESTATE_LAYOUT	4
+
+/* File layout: header, component records, padding up to a page boundary
+ * and the guest memory image, which is mapped copy-on-write on load. */
+struct SaveStateHeader {
+	char id[8];
+	Bit32u version;
+	Bit32u memsize;
+	Bit64s layout[SAVESTATE_LAYOUT];
+	Bit32u state_size;
+	Bit32u image_offset;
+};
+
+struct SaveStateComponent {
+	std::string name;
+	SAVESTATE_Handler * handler;
+};
+
+static std::vector<SaveStateComponent> components;
+
+static enum {
+	STATE_NONE,STATE_SAVE,STATE_LOAD
+} state_request;
+static std::string state_file;
+static bool state_startup;
+
+void SaveStream::Bytes(void * data,Bitu size) {
+	if (!loading) {
+		const Bit8u * bytes=(const Bit8u *)data;
+		out.insert(out.end(),bytes,bytes+size);
+		return;
+	}
+	if (failed || in_pos+size>in_size) {
+		/* A shorter record leaves the rest of the component as it is */
+		failed=true;
+		return;
+	}
+	memcpy(data,in+in_pos,size);
+	in_pos+=size;
+}
+
+void SaveStream::String(std::string & str) {
+	Bit32u len=(Bit32u)str.size();
+	Pod(len);
+	if (!loading) {
+		Bytes((void *)str.data(),len);
+		return;
+	}
+	if (failed || in_pos+len>in_size) {
+		failed=true;
+		return;
+	}
+	str.assign((const char *)in+in_pos,len);
+	in_pos+=len;
+}
+
+void SaveStream::CodePointer(Bitu & ptr) {
+	Bit8u null=(ptr==0);
+	Bit64s offset=null ? 0 : (Bit64s)(ptr-(Bitu)&SAVESTATE_Register);
+	Pod(null);
+	Pod(offset);
+	if (loading && !failed) ptr=null ? 0 : (Bitu)&SAVESTATE_Register+(Bitu)offset;
+}
+
+/* Code pointers are only valid in the same binary, a few distances
+ * between functions in different units catch a rebuilt executable */
+static void SAVESTATE_Layout(Bit64s * layout) {
+	Bitu base=(Bitu)&SAVESTATE_Register;
+	layout[0]=(Bit64s)((Bitu)&CPU_Core_Normal_Run-base);
+	layout[1]=(Bit64s)((Bitu)&PIC_RunQueue-base);
+	layout[2]=(Bit64s)((Bitu)&VGA_SetupHandlers-base);
+	layout[3]=(Bit64s)((Bitu)&MEM_MapImage-base);
+}
+
+void SAVESTATE_Register(const char * name,SAVESTATE_Handler * handler) {
+	for (Bitu i=0;i<components.size();i++) {
+		if (components[i].name==name) {
+			components[i].handler=handler;
+			return;
+		}
+	}
+	SaveStateComponent comp;
+	comp.name=name;
+	comp.handler=handler;
+	components.push_back(comp);
+}
+
+bool SAVESTATE_Save(const char * file) {
+	SaveStream state;
+	for (Bitu i=0;i<components.size();i++) {
+		SaveStream comp;
+		components[i].handler(comp);
+		if (comp.failed) {
+			LOG_MSG("Save state: %s can't be saved now",components[i].name.c_str());
+			return false;
+		}
+		Bit32u size=(Bit32u)comp.Data().size();
+		state.String(components[i].name);
+		state.Pod(size);
+		if (size) state.Bytes((void *)&comp.Data()[0],size);
+	}
+
+	SaveStateHeader header;
+	memset(&header,0,sizeof(header));
+	memcpy(header.id,SAVESTATE_ID,8);
+	header.version=SAVESTATE_VERSION;
+	header.memsize=(Bit32u)(MEM_TotalPages()*MEM_PAGESIZE);
+	SAVESTATE_Layout(header.layout);
+	header.state_size=(Bit32u)state.Data().size();
+	header.image_offset=(Bit32u)((sizeof(header)+header.state_size+MEM_PAGESIZE-1) & ~(MEM_PAGESIZE-1));
+
+	/* Write to a new file, instances may still have the old one mapped */
+	std::string temp=std::string(file)+".tmp";
+	FILE * f=fopen(temp.c_str(),"wb");
+	if (!f) {
+		LOG_MSG("Can't create save state %s",temp.c_str());
+		return false;
+	}
+	bool ok=fwrite(&header,1,sizeof(header),f)==sizeof(header);
+	if (ok && header.state_size) ok=fwrite(&state.Data()[0],1,header.state_size,f)==header.state_size;
+	Bitu pad=header.image_offset-sizeof(header)-header.state_size;
+	for (;ok && pad>0;pad--) ok=fputc(0,f)!=EOF;
+	if (ok) ok=MEM_WriteImage(f);
+	if (fclose(f)) ok=false;
+	if (ok) {
+		remove(file);
+		ok=rename(temp.c_str(),file)==0;
+	}
+	if (!ok) {
+		remove(temp.c_str());
+		LOG_MSG("Failed to write save state %s",file);
+		return false;
+	}
+	LOG_MSG("Saved state %s",file);
+	return true;
+}
+
+bool SAVESTATE_Load(const char * file) {
+	FILE * f=fopen(file,"rb");
+	if (!f) {
+		LOG_MSG("Can't open save state %s",file);
+		return false;
+	}
+	SaveStateHeader header;
+	Bit64s layout[SAVESTATE_LAYOUT];
+	SAVESTATE_Layout(layout);
+	if (fread(&header,1,sizeof(header),f)!=sizeof(header) || memcmp(header.id,SAVESTATE_ID,8) ||
+		header.version!=SAVESTATE_VERSION || memcmp(header.layout,layout,sizeof(layout))) {
+		fclose(f);
+		LOG_MSG("Save state %s was not made by this build",file);
+		return false;
+	}
+	if (header.memsize!=MEM_TotalPages()*MEM_PAGESIZE) {
+		fclose(f);
+		LOG_MSG("Save state %s has a different memsize",file);
+		return false;
+	}
+	std::vector<Bit8u> state(header.state_size+1);
+	bool ok=fread(&state[0],1,header.state_size,f)==header.state_size;
+	/* Guest memory comes first, the components fix up from it */
+	if (ok) ok=MEM_MapImage(f,header.image_offset);
+	fclose(f);
+	if (!ok) {
+		LOG_MSG("Save state %s is truncated",file);
+		return false;
+	}
+
+	SaveStream records(&state[0],header.state_size);
+	while (!records.failed) {
+		std::string name;
+		Bit32u size=0;
+		records.String(name);
+		records.Pod(size);
+		if (records.failed) break;
+		std::vector<Bit8u> data(size+1);
+		records.Bytes(&data[0],size);
+		if (records.failed) break;
+		for (Bitu i=0;i<components.size();i++) {
+			if (components[i].name!=name) continue;
+			SaveStream comp(&data[0],size);
+			components[i].handler(comp);
+			if (comp.failed) LOG_MSG("Save state: %s was only partly restored",name.c_str());
+			break;
+		}
+	}
+	LOG_MSG("Loaded state %s",file);
+	return true;
+}
+
+void SAVESTATE_Run(void) {
+	if (GCC_LIKELY(state_request==STATE_NONE)) return;
+	if (state_file.empty()) LOG_MSG("No save state file set");
+	else if (state_request==STATE_SAVE) SAVESTATE_Save(state_file.c_str());
+	else SAVESTATE_Load(state_file.c_str());
+	state_request=STATE_NONE;
+}
+
+void SAVESTATE_ShellReady(void) {
+	/* Restore the configured state once, after the autoexec has run */
+	if (state_startup) return;
+	state_startup=true;
+	if (state_file.empty()) return;
+	FILE * f=fopen(state_file.c_str(),"rb");
+	if (!f) return;
+	fclose(f);
+	state_request=STATE_LOAD;
+}
+
+static void SAVESTATE_SaveEvent(bool pressed) {
+	if (pressed) state_request=STATE_SAVE;
+}
+
+static void SAVESTATE_LoadEvent(bool pressed) {
+	if (pressed) state_request=STATE_LOAD;
+}
+
+void SAVESTATE_Init(Section * sec) {
+	Section_prop * section=static_cast<Section_prop *>(sec);
+	Prop_path * pathprop=section->Get_path("savestate");
+	if (pathprop) state_file=pathprop->realpath;
+	state_request=STATE_NONE;
+	MAPPER_AddHandler(SAVESTATE_SaveEvent,MK_f9,MMOD1|MMOD2,"savestate","Save State");
+	MAPPER_AddHandler(SAVESTATE_LoadEvent,MK_f10,MMOD1|MMOD2,"loadstate","Load State");
+}
@@ -31,6 +31,7 @@
 #include "callback.h"
 #include "support.h"
 #include "timer.h"
+#include "savestate.h"
 
 Bitu call_shellstop;
 bool insert;
@@ -398,6 +399,7 @@ void DOS_Shell::Run(void) {
 				if (echo) WriteOut("\n");
 			}
 		} else {
+			SAVESTATE_ShellReady();
 			if (echo) ShowPrompt();
 			LineInputFlag = true;
 			InputCommand(input_line);